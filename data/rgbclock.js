@@ -0,0 +1,55 @@
+// Fills the static control page with the state from /api/state
+
+function formatTime(time) {
+    var hours = Math.floor(time / 100);
+    var minutes = time % 100;
+    return (hours < 10 ? "0" : "") + hours + ":" + (minutes < 10 ? "0" : "") + minutes;
+}
+
+function fillColorMapSelect(select, colorMapNames, colorMapId) {
+    // Names come from the firmware, indexed by colour map ID
+    select.empty();
+    for (var i = 0; i < colorMapNames.length; i++) {
+        select.append($("<option>").val(i).text(colorMapNames[i]).prop("selected", i == colorMapId));
+    }
+}
+
+function fillCustomColors(container, colorMapId, customColors) {
+    container.empty();
+    var customIndex = customColors.ids.indexOf(colorMapId);
+    if (customIndex < 0) return;
+    var form = $("<form method='POST'>").attr("action", "/setcustomcolors" + (customIndex + 1));
+    var colors = customColors.colors[customIndex];
+    for (var digit = 0; digit < colors.length; digit++) {
+        form.append($("<input type='color'>").attr("name", "digit" + (digit + 1)).val(colors[digit]));
+    }
+    form.append($("<input type='submit' value='Set'/>"));
+    container.append($("<h4>Custom Colour Scheme</h4>"), form);
+}
+
+function fillModeSettings(section, settings, state) {
+    fillColorMapSelect($(".colormap-select", section), state.colormaps, settings.colormap);
+    fillCustomColors($(".custom-colors", section), settings.colormap, state.custom);
+    $("input[name='brightness']", section).val(settings.brightness);
+}
+
+function updateStateCallback(state) {
+    $("input[name='start']").val(formatTime(state.night_start));
+    $("input[name='end']").val(formatTime(state.night_end));
+
+    $("input[name='force-enabled']").prop("checked", (state.force_mode & 1) != 0);
+    $("input[name='force-which'][value='day']").prop("checked", (state.force_mode & 2) != 0);
+    $("input[name='force-which'][value='night']").prop("checked", (state.force_mode & 2) == 0);
+    $("input[name='force-permanent']").prop("checked", (state.force_mode & 4) != 0);
+
+    $("input[name='brightness-curve'][value='" + state.brightness_curve + "']").prop("checked", true);
+    $("input[name='auto-brightness']").prop("checked", state.auto_brightness);
+    $("input[name='ctrl-src'][value='" + state.ctrl_src + "']").prop("checked", true);
+
+    fillModeSettings($("#day-settings"), state.day, state);
+    fillModeSettings($("#night-settings"), state.night, state);
+}
+
+$(document).ready(function() {
+    $.getJSON("/api/state", updateStateCallback);
+});
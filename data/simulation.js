@@ -1,11 +1,29 @@
 var svgRoot;
+var segmentColors = [];
 
 function simulation_init() {
     var svg = document.getElementById("svg");
     svg.addEventListener("load", function() {
         var svgDoc = svg.contentDocument;
         svgRoot  = svgDoc.documentElement;
+        redrawSegments();
     }, false);
+    if (window.EventSource) {
+        // Pushed by the clock whenever the LEDs change
+        var events = new EventSource("/events");
+        events.onmessage = updateSegmentsEvent;
+        events.onerror = function() {
+            // After a dropped connection the browser reconnects on its own (readyState CONNECTING).
+            // It only gives up if the clock refused the stream (503, too many viewers),
+            // then fall back to polling the frame snapshot.
+            if (events.readyState == EventSource.CLOSED) startPolling();
+        };
+    } else {
+        startPolling();
+    }
+}
+
+function startPolling() {
     setInterval(updateSegments, 10000);
     updateSegments();
 }
@@ -24,18 +42,43 @@ function digitToSegments(digit) {
     return segments;
 }
 
-function updateSegmentsCallback(data) {
-    var segmentColors = data.split("\n");
+function updateSegmentsEvent(event) {
+    // Changed segments only, 8 hex characters each: segment index (digit * 7 + segment) and RRGGBB
+    var data = event.data;
+    for (var i = 0; i + 8 <= data.length; i += 8) {
+        var index = parseInt(data.substr(i, 2), 16);
+        segmentColors[index] = data.substr(i + 2, 6);
+        setColor(Math.floor(index / 7), index % 7, segmentColors[index]);
+    }
+}
+
+function updateSegmentsCallback(buffer) {
+    // One RGB triplet per segment, as shown on the LEDs
+    var frame = new Uint8Array(buffer);
+    for (var i = 0; i < frame.length / 3; i++) {
+        var color = (frame[i * 3] << 16) | (frame[i * 3 + 1] << 8) | frame[i * 3 + 2];
+        segmentColors[i] = ("00000" + color.toString(16)).slice(-6);
+    }
+    redrawSegments();
+}
+
+function redrawSegments() {
     for (var digit = 0; digit < 4; digit++) {
         for (var segment = 0; segment < 7; segment++) {
             var color = segmentColors[digit * 7 + segment];
-            setColor(digit, segment, color);
+            if (color !== undefined) setColor(digit, segment, color);
         }
     }
 }
 
 function updateSegments() {
-    $.get("/getsegmentcolors", updateSegmentsCallback);
+    var request = new XMLHttpRequest();
+    request.open("GET", "/frame?agg=segment");
+    request.responseType = "arraybuffer";
+    request.onload = function() {
+        if (request.status == 200) updateSegmentsCallback(request.response);
+    };
+    request.send();
 }
 
 function setColor(digit, segment, color) {
@@ -0,0 +1,48 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "Adafruit_NeoPixel.h"
+
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint8_t p, uint16_t t)
+  : numLEDs(n), rOffset((t >> 4) & 0x03), gOffset((t >> 2) & 0x03), bOffset(t & 0x03), buffer(n * 3, 0) {
+  (void)p;
+}
+
+void Adafruit_NeoPixel::begin() {
+}
+
+void Adafruit_NeoPixel::show() {
+  frames.push_back(buffer);
+}
+
+void Adafruit_NeoPixel::clear() {
+  buffer.assign(buffer.size(), 0);
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+  if (n >= numLEDs) return;
+  uint8_t* p = &buffer[n * 3];
+  p[rOffset] = r;
+  p[gOffset] = g;
+  p[bOffset] = b;
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint32_t c) {
+  setPixelColor(n, c >> 16, c >> 8, c);
+}
+
+uint32_t Adafruit_NeoPixel::getPixelColor(uint16_t n) const {
+  if (n >= numLEDs) return 0;
+  const uint8_t* p = &buffer[n * 3];
+  return (uint32_t)p[rOffset] << 16 | (uint32_t)p[gOffset] << 8 | p[bOffset];
+}
+
+uint8_t* Adafruit_NeoPixel::getPixels() const {
+  return const_cast<uint8_t*>(buffer.data());
+}
+
+uint16_t Adafruit_NeoPixel::numPixels() const {
+  return numLEDs;
+}
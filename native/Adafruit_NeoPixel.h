@@ -0,0 +1,48 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Host stand-in for Adafruit_NeoPixel. Instead of driving a strip,
+   every show() appends a copy of the pixel buffer to frames.
+*/
+
+#ifndef NATIVE_ADAFRUIT_NEOPIXEL_H
+#define NATIVE_ADAFRUIT_NEOPIXEL_H
+
+#include <stdint.h>
+#include <vector>
+
+#define NEO_RGB ((0 << 6) | (0 << 4) | (1 << 2) | (2))
+#define NEO_RBG ((0 << 6) | (0 << 4) | (2 << 2) | (1))
+#define NEO_GRB ((1 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_GBR ((2 << 6) | (2 << 4) | (0 << 2) | (1))
+#define NEO_BRG ((1 << 6) | (1 << 4) | (2 << 2) | (0))
+#define NEO_BGR ((2 << 6) | (2 << 4) | (1 << 2) | (0))
+#define NEO_KHZ800 0x0000
+#define NEO_KHZ400 0x0100
+
+class Adafruit_NeoPixel {
+  public:
+    Adafruit_NeoPixel(uint16_t n, uint8_t p = 6, uint16_t t = NEO_GRB + NEO_KHZ800);
+
+    void begin();
+    void show();
+    void clear();
+    void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
+    void setPixelColor(uint16_t n, uint32_t c);
+    uint32_t getPixelColor(uint16_t n) const;
+    uint8_t* getPixels() const;
+    uint16_t numPixels() const;
+
+    // Host only: copies of the pixel buffer at every show()
+    std::vector<std::vector<uint8_t> > frames;
+
+  private:
+    uint16_t numLEDs;
+    uint8_t rOffset;
+    uint8_t gOffset;
+    uint8_t bOffset;
+    std::vector<uint8_t> buffer;
+};
+
+#endif
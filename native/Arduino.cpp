@@ -0,0 +1,161 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include <Arduino.h>
+#include <chrono>
+
+#define NATIVE_FREE_HEAP 40000
+#define NATIVE_CPU_MHZ 80
+// The device's RTC clock runs from a ~150 kHz oscillator
+#define NATIVE_RTC_PERIOD_US 6
+
+EspClass ESP;
+
+static uint8_t simulatedFlash[NATIVE_FLASH_SECTORS * SPI_FLASH_SEC_SIZE];
+static bool simulatedFlashErased = false;
+static uint8_t simulatedRtcMemory[512];
+static bool simulatedRtcMemoryInitialized = false;
+
+static unsigned long long simulatedMicros = 0;
+
+unsigned long millis() {
+  return (unsigned long)(simulatedMicros / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)simulatedMicros;
+}
+
+void delay(unsigned long ms) {
+  nativeAdvanceMillis(ms);
+}
+
+void yield() {
+}
+
+void nativeAdvanceMillis(unsigned long ms) {
+  simulatedMicros += (unsigned long long)ms * 1000;
+}
+
+uint32_t system_get_rtc_time() {
+  return (uint32_t)(simulatedMicros / NATIVE_RTC_PERIOD_US);
+}
+
+uint32_t system_rtc_clock_cali_proc() {
+  return NATIVE_RTC_PERIOD_US << 12;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+static int simulatedAnalog = 0;
+
+int analogRead(uint8_t pin) {
+  (void)pin;
+  return simulatedAnalog;
+}
+
+void nativeSetAnalog(int value) {
+  simulatedAnalog = value;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  // Same implementation as the ESP8266 core
+  long divisor = (in_max - in_min);
+  if (divisor == 0) return -1;
+  return (x - in_min) * (out_max - out_min) / divisor + out_min;
+}
+
+long random(long howbig) {
+  if (howbig == 0) return 0;
+  return rand() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0) srand(seed);
+}
+
+uint32_t EspClass::getFreeHeap() {
+  return NATIVE_FREE_HEAP;
+}
+
+uint32_t EspClass::getMaxFreeBlockSize() {
+  return NATIVE_FREE_HEAP;
+}
+
+uint8_t EspClass::getCpuFreqMHz() {
+  return NATIVE_CPU_MHZ;
+}
+
+uint32_t EspClass::getCycleCount() {
+  // Cycles of an 80 MHz core. Simulated time plus the host's real time since start, so it
+  // advances with millis() (like on the device) and still measures the code in between.
+  static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  unsigned long long realMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  return (simulatedMicros + realMicros) * NATIVE_CPU_MHZ;
+}
+
+static bool flashRangeValid(uint32_t offset, size_t size) {
+  if (!simulatedFlashErased) {
+    // A fresh chip
+    memset(simulatedFlash, 0xFF, sizeof(simulatedFlash));
+    simulatedFlashErased = true;
+  }
+  // Like the SDK, offsets and sizes have to be word aligned
+  return offset % 4 == 0 && size % 4 == 0 && offset + size <= sizeof(simulatedFlash);
+}
+
+bool EspClass::flashEraseSector(uint32_t sector) {
+  if (!flashRangeValid(sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE)) return false;
+  memset(simulatedFlash + sector * SPI_FLASH_SEC_SIZE, 0xFF, SPI_FLASH_SEC_SIZE);
+  flashErases++;
+  return true;
+}
+
+bool EspClass::flashWrite(uint32_t offset, uint32_t* data, size_t size) {
+  if (!flashRangeValid(offset, size)) return false;
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (size_t i = 0; i < size; i++) {
+    simulatedFlash[offset + i] &= bytes[i];
+  }
+  flashWrites++;
+  return true;
+}
+
+bool EspClass::flashRead(uint32_t offset, uint32_t* data, size_t size) {
+  if (!flashRangeValid(offset, size)) return false;
+  memcpy(data, simulatedFlash + offset, size);
+  return true;
+}
+
+static bool rtcRangeValid(uint32_t offset, size_t size) {
+  if (!simulatedRtcMemoryInitialized) {
+    // Undefined contents after a power-on
+    for (size_t i = 0; i < sizeof(simulatedRtcMemory); i++) {
+      simulatedRtcMemory[i] = rand();
+    }
+    simulatedRtcMemoryInitialized = true;
+  }
+  return size % 4 == 0 && offset * 4 + size <= sizeof(simulatedRtcMemory);
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size) {
+  if (!rtcRangeValid(offset, size)) return false;
+  memcpy(data, simulatedRtcMemory + offset * 4, size);
+  return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size) {
+  if (!rtcRangeValid(offset, size)) return false;
+  memcpy(simulatedRtcMemory + offset * 4, data, size);
+  return true;
+}
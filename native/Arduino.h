@@ -0,0 +1,93 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Host stand-in for the parts of the Arduino core used by the display logic.
+   millis() is simulated and only advances through delay() / nativeAdvanceMillis().
+*/
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "WString.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// There is no separate flash address space on the host
+#define PROGMEM
+#define ICACHE_RAM_ATTR
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+
+#define A0 17
+#define INPUT 0x00
+#define OUTPUT 0x01
+
+#define PI 3.1415926535897932384626433832795
+#define F_CPU 80000000L
+#define SPI_FLASH_SEC_SIZE 4096
+// Size of the simulated flash, starting at offset 0
+#define NATIVE_FLASH_SECTORS 4
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+int analogRead(uint8_t pin);
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// SDK RTC timer, on the device it keeps counting through soft resets.
+// Calibration is the tick period in us, as a 12 bit fixed point value.
+uint32_t system_get_rtc_time();
+uint32_t system_rtc_clock_cali_proc();
+
+class EspClass {
+  public:
+    // Fixed on the host, there is no heap limit to report
+    uint32_t getFreeHeap();
+    // As in later ESP8266 cores, stubbed: all free heap is one block
+    uint32_t getMaxFreeBlockSize();
+    uint32_t getCycleCount();
+    uint8_t getCpuFreqMHz();
+
+    // RAM backed flash with NOR semantics: erasing sets all bits, writing can only clear them
+    bool flashEraseSector(uint32_t sector);
+    bool flashWrite(uint32_t offset, uint32_t* data, size_t size);
+    bool flashRead(uint32_t offset, uint32_t* data, size_t size);
+
+    // 512 bytes like the SDK's user area, offset in 4 byte blocks. Survives nothing on the host,
+    // but starts out random like after a power-on.
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+
+    // Host only: operation counters
+    unsigned long flashErases = 0;
+    unsigned long flashWrites = 0;
+};
+
+extern EspClass ESP;
+
+// Host only: advance the simulated clock
+void nativeAdvanceMillis(unsigned long ms);
+// Host only: value returned by analogRead() from now on
+void nativeSetAnalog(int value);
+
+#endif
@@ -0,0 +1,108 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "ESP8266WebServer.h"
+
+ESP8266WebServer::ESP8266WebServer(int port) {
+  (void)port;
+}
+
+void ESP8266WebServer::begin() {
+}
+
+void ESP8266WebServer::handleClient() {
+}
+
+void ESP8266WebServer::on(const String& uri, THandlerFunction handler) {
+  _handlers.push_back(std::make_pair(uri, handler));
+}
+
+void ESP8266WebServer::onNotFound(THandlerFunction fn) {
+  _notFoundHandler = fn;
+}
+
+String ESP8266WebServer::arg(const String& name) {
+  for (size_t i = 0; i < _currentArgs.size(); i++) {
+    if (_currentArgs[i].first == name) return _currentArgs[i].second;
+  }
+  return String();
+}
+
+String ESP8266WebServer::arg(int i) {
+  if (i < 0 || (size_t)i >= _currentArgs.size()) return String();
+  return _currentArgs[i].second;
+}
+
+String ESP8266WebServer::argName(int i) {
+  if (i < 0 || (size_t)i >= _currentArgs.size()) return String();
+  return _currentArgs[i].first;
+}
+
+int ESP8266WebServer::args() {
+  return _currentArgs.size();
+}
+
+bool ESP8266WebServer::hasArg(const String& name) {
+  for (size_t i = 0; i < _currentArgs.size(); i++) {
+    if (_currentArgs[i].first == name) return true;
+  }
+  return false;
+}
+
+void ESP8266WebServer::sendHeader(const String& name, const String& value, bool first) {
+  if (first) {
+    responseHeaders.insert(responseHeaders.begin(), std::make_pair(name, value));
+  } else {
+    responseHeaders.push_back(std::make_pair(name, value));
+  }
+}
+
+void ESP8266WebServer::send(int code, const char* content_type, const String& content) {
+  responseCode = code;
+  responseContentType = content_type;
+  responseBody.append(content.c_str(), content.length());
+}
+
+void ESP8266WebServer::send(int code, const String& content_type, const String& content) {
+  send(code, content_type.c_str(), content);
+}
+
+void ESP8266WebServer::send_P(int code, PGM_P content_type, PGM_P content, size_t contentLength) {
+  responseCode = code;
+  responseContentType = content_type;
+  responseContentLength = contentLength;
+  responseBody.append(content, contentLength);
+}
+
+void ESP8266WebServer::setContentLength(size_t contentLength) {
+  responseContentLength = contentLength;
+}
+
+void ESP8266WebServer::sendContent(const String& content) {
+  responseBody.append(content.c_str(), content.length());
+}
+
+void ESP8266WebServer::sendContent_P(PGM_P content, size_t size) {
+  responseBody.append(content, size);
+}
+
+void ESP8266WebServer::request(HTTPMethod method, const String& uri, const ArgList& args) {
+  _currentMethod = method;
+  _currentUri = uri;
+  _currentArgs = args;
+  responseCode = 0;
+  responseContentType = String();
+  responseBody.clear();
+  responseContentLength = CONTENT_LENGTH_UNKNOWN;
+  responseHeaders.clear();
+
+  for (size_t i = 0; i < _handlers.size(); i++) {
+    if (_handlers[i].first == uri) {
+      _handlers[i].second();
+      return;
+    }
+  }
+  if (_notFoundHandler) _notFoundHandler();
+}
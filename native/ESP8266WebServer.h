@@ -0,0 +1,67 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Host stand-in for ESP8266WebServer. There is no socket; requests are
+   injected with request() and the response is captured in memory.
+*/
+
+#ifndef NATIVE_ESP8266WEBSERVER_H
+#define NATIVE_ESP8266WEBSERVER_H
+
+#include <Arduino.h>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t) -1)
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+class ESP8266WebServer {
+  public:
+    typedef std::function<void(void)> THandlerFunction;
+    typedef std::vector<std::pair<String, String> > ArgList;
+
+    ESP8266WebServer(int port = 80);
+
+    void begin();
+    void handleClient();
+    void on(const String& uri, THandlerFunction handler);
+    void onNotFound(THandlerFunction fn);
+
+    String uri() { return _currentUri; }
+    HTTPMethod method() { return _currentMethod; }
+    String arg(const String& name);
+    String arg(int i);
+    String argName(int i);
+    int args();
+    bool hasArg(const String& name);
+
+    void sendHeader(const String& name, const String& value, bool first = false);
+    void send(int code, const char* content_type = NULL, const String& content = String(""));
+    void send(int code, const String& content_type, const String& content);
+    void send_P(int code, PGM_P content_type, PGM_P content, size_t contentLength);
+    void setContentLength(size_t contentLength);
+    void sendContent(const String& content);
+    void sendContent_P(PGM_P content, size_t size);
+
+    // Host only: dispatch a request to the registered handlers and capture the response
+    void request(HTTPMethod method, const String& uri, const ArgList& args = ArgList());
+
+    int responseCode = 0;
+    String responseContentType;
+    std::string responseBody;
+    size_t responseContentLength = CONTENT_LENGTH_UNKNOWN;
+    ArgList responseHeaders;
+
+  private:
+    std::vector<std::pair<String, THandlerFunction> > _handlers;
+    THandlerFunction _notFoundHandler;
+    String _currentUri;
+    HTTPMethod _currentMethod = HTTP_GET;
+    ArgList _currentArgs;
+};
+
+#endif
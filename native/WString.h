@@ -0,0 +1,59 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Host stand-in for the Arduino String class, backed by std::string.
+*/
+
+#ifndef NATIVE_WSTRING_H
+#define NATIVE_WSTRING_H
+
+#include <string>
+
+class String {
+  public:
+    String() {}
+    String(const char* str) : _str(str ? str : "") {}
+    String(const std::string& str) : _str(str) {}
+    String(char c) : _str(1, c) {}
+    explicit String(int value) : _str(std::to_string(value)) {}
+    explicit String(unsigned int value) : _str(std::to_string(value)) {}
+    explicit String(long value) : _str(std::to_string(value)) {}
+    explicit String(unsigned long value) : _str(std::to_string(value)) {}
+
+    const char* c_str() const { return _str.c_str(); }
+    unsigned int length() const { return _str.length(); }
+    char operator[](unsigned int index) const { return _str[index]; }
+
+    String& operator+=(const String& rhs) { _str += rhs._str; return *this; }
+    String& operator+=(const char* rhs) { _str += rhs; return *this; }
+    String& operator+=(char rhs) { _str += rhs; return *this; }
+    String& operator+=(int rhs) { _str += std::to_string(rhs); return *this; }
+    String& operator+=(unsigned int rhs) { _str += std::to_string(rhs); return *this; }
+    String& operator+=(long rhs) { _str += std::to_string(rhs); return *this; }
+    String& operator+=(unsigned long rhs) { _str += std::to_string(rhs); return *this; }
+
+    bool operator==(const String& rhs) const { return _str == rhs._str; }
+    bool operator==(const char* rhs) const { return _str == rhs; }
+    bool operator!=(const String& rhs) const { return _str != rhs._str; }
+    bool operator!=(const char* rhs) const { return _str != rhs; }
+
+    int indexOf(const String& str) const {
+      std::string::size_type pos = _str.find(str._str);
+      return pos == std::string::npos ? -1 : (int)pos;
+    }
+    bool startsWith(const String& prefix) const { return _str.compare(0, prefix._str.length(), prefix._str) == 0; }
+    bool endsWith(const String& suffix) const {
+      return _str.length() >= suffix._str.length() &&
+             _str.compare(_str.length() - suffix._str.length(), suffix._str.length(), suffix._str) == 0;
+    }
+
+  private:
+    std::string _str;
+};
+
+inline String operator+(const String& lhs, const String& rhs) { String s(lhs); s += rhs; return s; }
+inline String operator+(const String& lhs, const char* rhs) { String s(lhs); s += rhs; return s; }
+inline String operator+(const char* lhs, const String& rhs) { String s(lhs); s += rhs; return s; }
+
+#endif
@@ -0,0 +1,141 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Host driver for the display core. Replays a day of time updates against
+   the stand-in hardware and reports what ended up on the (recorded) strip.
+
+   Usage: program [--animate] [--dump | --bench | --adc <trace> | --profile <file>]
+     --animate  Run the animation engine (with crossfades) from the scheduler between updates
+     --dump     Print every committed frame as hex, one line per pixels.show()
+     --bench    Run the render path microbenchmarks and print the results as JSON
+     --adc      Replay an ADC trace (one reading per line, AMBIENT_SAMPLE_INTERVAL_MS apart)
+                through the auto-brightness pipeline. With --dump, print "ms raw level brightness"
+                for every sample.
+     --profile  Simulate NATIVE_PROFILE_DAYS days under the sampling profiler and write /profile
+                to the file, for tools/symbolize_profile.py. Needs -D ENABLE_PROFILER.
+*/
+
+#include <Arduino.h>
+
+#include "ambient.h"
+#include "animation.h"
+#include "benchmark.h"
+#include "display.h"
+#include "profiler.h"
+#include "scheduler.h"
+#include "simulation.h"
+#include "web.h"
+
+// The unit tests in test/ bring their own main()
+#ifndef PIO_UNIT_TESTING
+
+// One day takes a few ms of CPU time, too short for a meaningful profile
+#define NATIVE_PROFILE_DAYS 100
+
+void dumpFrames() {
+  for (size_t f = 0; f < pixels.frames.size(); f++) {
+    const std::vector<uint8_t>& frame = pixels.frames[f];
+    for (size_t i = 0; i < frame.size(); i++) {
+      printf("%02x", frame[i]);
+    }
+    printf("\n");
+  }
+}
+
+int replayAdcTrace(const char* path, bool dump) {
+  FILE* trace = fopen(path, "r");
+  if (trace == NULL) {
+    fprintf(stderr, "Can't open %s\n", path);
+    return 1;
+  }
+
+  simulationBeginAmbient();
+  unsigned long framesBefore = framesCommitted;
+  unsigned long samples = 0;
+  int raw;
+  while (readAdcTrace(trace, &raw)) {
+    simulateAdcSample(raw);
+    if (dump) printf("%lu %d %d %d\n", samples * AMBIENT_SAMPLE_INTERVAL_MS, raw, ambientLevel(), curBrightness);
+    samples++;
+  }
+  fclose(trace);
+
+  if (!dump) {
+    printf("{\"samples\": %lu, \"output_changes\": %lu, \"frames_committed\": %lu, \"final_brightness\": %d}\n",
+           samples, ambientOutputChanges(), framesCommitted - framesBefore, curBrightness);
+  }
+  return 0;
+}
+
+#ifdef ENABLE_PROFILER
+int profileDays(const char* path, bool animate) {
+  profilerBegin();
+  for (int day = 0; day < NATIVE_PROFILE_DAYS; day++) {
+    simulateDay(animate);
+    pixels.frames.clear();
+  }
+  profilerStop();
+
+  FILE* profile = fopen(path, "w");
+  if (profile == NULL) {
+    fprintf(stderr, "Can't open %s\n", path);
+    return 1;
+  }
+  server.request(HTTP_GET, "/profile");
+  fwrite(server.responseBody.data(), 1, server.responseBody.size(), profile);
+  fclose(profile);
+  return 0;
+}
+#endif
+
+int main(int argc, char** argv) {
+  bool dump = false;
+  bool bench = false;
+  bool animate = false;
+  const char* adcTrace = NULL;
+  const char* profilePath = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--adc") == 0 && i + 1 < argc) adcTrace = argv[++i];
+    if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) profilePath = argv[++i];
+    if (strcmp(argv[i], "--animate") == 0) animate = true;
+    if (strcmp(argv[i], "--dump") == 0) dump = true;
+    if (strcmp(argv[i], "--bench") == 0) bench = true;
+  }
+
+  simulationBegin();
+
+  if (bench) {
+    updateAll();
+    printf("%s\n", runBenchmarks().c_str());
+    return 0;
+  }
+
+  if (adcTrace != NULL) {
+    return replayAdcTrace(adcTrace, dump);
+  }
+
+  if (animate) {
+    animationBegin();
+    animationSetCrossfade(true);
+  }
+  if (profilePath != NULL) {
+#ifdef ENABLE_PROFILER
+    return profileDays(profilePath, animate);
+#else
+    fprintf(stderr, "Built without -D ENABLE_PROFILER\n");
+    return 1;
+#endif
+  }
+  simulateDay(animate);
+
+  if (dump) {
+    dumpFrames();
+  } else {
+    printf("{\"frames_committed\": %lu, \"frames_skipped\": %lu, \"frames_recorded\": %u}\n",
+           framesCommitted, framesSkipped, (unsigned int)pixels.frames.size());
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "simulation.h"
+#include "ambient.h"
+#include "config.h"
+#include "display.h"
+#include "scheduler.h"
+
+void simulationBegin() {
+  configBegin();
+  pixels.begin();
+
+  nightModeStartTime = 2200;
+  nightModeEndTime = 700;
+  dayColorMap = getColorMap(dayColorMapId = 1);
+  nightColorMap = getColorMap(nightColorMapId = 2);
+}
+
+void runScheduler(unsigned long durationMs) {
+  // Jump from deadline to deadline instead of idling in real time
+  unsigned long end = millis() + durationMs;
+  while ((long)(end - millis()) > 0) {
+    schedulerRun();
+    unsigned long step = schedulerMsToNextDeadline();
+    unsigned long remaining = end - millis();
+    if (step == 0) step = 1;
+    nativeAdvanceMillis(step < remaining ? step : remaining);
+  }
+}
+
+void simulationBeginAmbient() {
+  autoBrightness = true;
+  curTime = 1200;
+  updateAll();
+  ambientBegin();
+}
+
+bool readAdcTrace(FILE* trace, int* raw) {
+  char line[256];
+  while (fgets(line, sizeof(line), trace) != NULL) {
+    if (line[0] == '#' || line[0] == '\n') continue;
+    *raw = atoi(line);
+    return true;
+  }
+  return false;
+}
+
+void simulateAdcSample(int raw) {
+  nativeSetAnalog(raw);
+  runScheduler(AMBIENT_SAMPLE_INTERVAL_MS);
+  if (updateRequested) updateAll();
+}
+
+void simulateDay(bool animate) {
+  for (int minuteOfDay = 0; minuteOfDay < 24 * 60; minuteOfDay++) {
+    curTime = (minuteOfDay / 60) * 100 + minuteOfDay % 60;
+    for (unsigned long ms = 0; ms < 60000; ms += NATIVE_UPDATE_INTERVAL_MS) {
+      updateAll();
+      if (animate) {
+        runScheduler(NATIVE_UPDATE_INTERVAL_MS);
+      } else {
+        nativeAdvanceMillis(NATIVE_UPDATE_INTERVAL_MS);
+      }
+    }
+  }
+}
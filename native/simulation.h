@@ -0,0 +1,31 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Simulation runs shared by the host driver (main.cpp) and the unit tests in test/.
+   Time only moves through nativeAdvanceMillis(), so runs are deterministic and take no real time.
+*/
+
+#ifndef NATIVE_SIMULATION_H
+#define NATIVE_SIMULATION_H
+
+#include <Arduino.h>
+#include <stdio.h>
+
+#define NATIVE_UPDATE_INTERVAL_MS 5000
+
+// Config, strip and the day / night colour maps every simulation starts from
+void simulationBegin();
+// Runs the scheduler for durationMs of simulated time, jumping from deadline to deadline
+void runScheduler(unsigned long durationMs);
+// One updateAll() every NATIVE_UPDATE_INTERVAL_MS for 24 h, with the scheduler in between if animate
+void simulateDay(bool animate);
+
+// Auto-brightness from the (simulated) LDR, from a committed noon frame on
+void simulationBeginAmbient();
+// Next reading of an ADC trace (one per line, # starts a comment), false at the end
+bool readAdcTrace(FILE* trace, int* raw);
+// Feeds one ADC reading: runs the scheduler for AMBIENT_SAMPLE_INTERVAL_MS and renders if requested
+void simulateAdcSample(int raw);
+
+#endif
@@ -0,0 +1,126 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "ambient.h"
+#include "display.h"
+#include "scheduler.h"
+#include "web.h"
+
+/*
+   GLOBAL VARIABLES
+*/
+
+const AmbientCurvePoint AMBIENT_CURVE_POINTS[] = AMBIENT_CURVE;
+#define AMBIENT_CURVE_SIZE (sizeof(AMBIENT_CURVE_POINTS) / sizeof(AMBIENT_CURVE_POINTS[0]))
+
+int medianWindow[AMBIENT_MEDIAN_SIZE];
+byte medianPos = 0;
+byte medianCount = 0;
+
+// Filtered level in 1/16 ADC counts
+long emaLevel = 0;
+bool emaValid = false;
+
+// Filtered level the current output was chosen at
+int outputLevel = 0;
+bool outputValid = false;
+
+int lastRaw = 0;
+unsigned long ambientSamples = 0;
+unsigned long ambientChanges = 0;
+
+/*
+   HELPER FUNCTIONS
+*/
+
+int medianOfWindow() {
+  int sorted[AMBIENT_MEDIAN_SIZE];
+  memcpy(sorted, medianWindow, medianCount * sizeof(int));
+  for (byte i = 1; i < medianCount; i++) {
+    int value = sorted[i];
+    byte j = i;
+    for (; j > 0 && sorted[j - 1] > value; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = value;
+  }
+  return sorted[medianCount / 2];
+}
+
+void ambientJob() {
+  // No ADC reads or filtering while unused. The filter starts over when auto-brightness is
+  // turned on again, its first sample then sets the brightness without hysteresis.
+  if (!autoBrightness) {
+    medianCount = 0;
+    emaValid = false;
+    outputValid = false;
+    return;
+  }
+  ambientSample(analogRead(LDR_PIN));
+}
+
+void writeAmbientStats(ChunkedResponse& out) {
+  out.printSignedMetric(PSTR("ambient_raw"), METRIC_GAUGE, lastRaw);
+  out.printSignedMetric(PSTR("ambient_level"), METRIC_GAUGE, ambientLevel());
+  out.printMetric(PSTR("ambient_brightness"), METRIC_GAUGE, ambientBrightness);
+  out.printMetric(PSTR("ambient_samples_total"), METRIC_COUNTER, ambientSamples);
+  out.printMetric(PSTR("ambient_output_changes_total"), METRIC_COUNTER, ambientChanges);
+}
+
+/*
+   PUBLIC FUNCTIONS
+*/
+
+void ambientBegin() {
+  schedulerAdd("ambient", ambientJob, AMBIENT_SAMPLE_INTERVAL_MS);
+  webAddStatsWriter(writeAmbientStats);
+}
+
+void ambientSample(int raw) {
+  lastRaw = raw;
+  ambientSamples++;
+  if (AMBIENT_INVERT) raw = 1023 - raw;
+
+  // Median first, so single spikes (e.g. a camera flash) never reach the EMA
+  medianWindow[medianPos] = raw;
+  medianPos = (medianPos + 1) % AMBIENT_MEDIAN_SIZE;
+  if (medianCount < AMBIENT_MEDIAN_SIZE) medianCount++;
+  long median = (long)medianOfWindow() << 4;
+  if (!emaValid) {
+    emaLevel = median;
+    emaValid = true;
+  } else {
+    emaLevel += (median - emaLevel) >> AMBIENT_EMA_SHIFT;
+  }
+
+  int level = ambientLevel();
+  if (outputValid && abs(level - outputLevel) < AMBIENT_HYSTERESIS) return;
+  outputLevel = level;
+  outputValid = true;
+
+  byte brightness = ambientCurve(level);
+  if (brightness == ambientBrightness) return;
+  ambientBrightness = brightness;
+  ambientChanges++;
+  if (autoBrightness) requestUpdate();
+}
+
+byte ambientCurve(int level) {
+  if (level <= AMBIENT_CURVE_POINTS[0].level) return AMBIENT_CURVE_POINTS[0].brightness;
+  for (byte i = 1; i < AMBIENT_CURVE_SIZE; i++) {
+    const AmbientCurvePoint& a = AMBIENT_CURVE_POINTS[i - 1];
+    const AmbientCurvePoint& b = AMBIENT_CURVE_POINTS[i];
+    if (level <= b.level) {
+      return a.brightness + (long)(b.brightness - a.brightness) * (level - a.level) / (b.level - a.level);
+    }
+  }
+  return AMBIENT_CURVE_POINTS[AMBIENT_CURVE_SIZE - 1].brightness;
+}
+
+int ambientLevel() {
+  return (emaLevel + 8) >> 4;
+}
+
+unsigned long ambientOutputChanges() {
+  return ambientChanges;
+}
@@ -0,0 +1,49 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Auto-brightness from the light sensor on LDR_PIN.
+   The ADC is sampled from a scheduler job, filtered (median of AMBIENT_MEDIAN_SIZE, then an EMA)
+   and mapped to a brightness through AMBIENT_CURVE. The output only moves once the filtered
+   level left a hysteresis band around the level it was last chosen at, and only an actual change
+   of the output requests a re-render, so sensor noise doesn't cause a stream of frames.
+*/
+
+#ifndef AMBIENT_H
+#define AMBIENT_H
+
+#include <Arduino.h>
+
+#define AMBIENT_SAMPLE_INTERVAL_MS 100
+#define AMBIENT_MEDIAN_SIZE 5
+// EMA weight of a new (median filtered) sample is 1 / 2^AMBIENT_EMA_SHIFT
+#define AMBIENT_EMA_SHIFT 3
+// ADC counts the filtered level has to move before the brightness is reconsidered
+#define AMBIENT_HYSTERESIS 24
+
+// ADC reading (0 ... 1023) to brightness, linearly interpolated between the points.
+// The ADC isn't calibrated, so the levels are relative to the LDR and its divider, not lux.
+// This and AMBIENT_INVERT are build flags, see settings.template.h.
+#ifndef AMBIENT_CURVE
+#define AMBIENT_CURVE {{0, 8}, {64, 24}, {256, 96}, {640, 192}, {1023, 255}}
+#endif
+// Set if the LDR is wired so that more light gives a lower reading
+#ifndef AMBIENT_INVERT
+#define AMBIENT_INVERT false
+#endif
+
+struct AmbientCurvePoint {
+  int level;
+  byte brightness;
+};
+
+// Registers the sampling job and the stats writer
+void ambientBegin();
+// Feeds one raw ADC reading through the pipeline (called by the sampling job)
+void ambientSample(int raw);
+// Brightness for a filtered level, without hysteresis
+byte ambientCurve(int level);
+int ambientLevel();
+unsigned long ambientOutputChanges();
+
+#endif
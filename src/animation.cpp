@@ -0,0 +1,190 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "animation.h"
+#include "display.h"
+#include "scheduler.h"
+#include "timekeeping.h"
+#include "web.h"
+
+#define ANIMATION_FRAME_INTERVAL_MS (1000 / ANIMATION_FPS)
+
+/*
+   GLOBAL VARIABLES
+*/
+
+int animationJobId = -1;
+
+// Segment colours at the start of the running transition, and as last written to the LEDs (without pulse)
+unsigned long fromColors[NUM_SEGMENTS];
+unsigned long shownColors[NUM_SEGMENTS];
+
+bool transitionRunning = false;
+bool transitionViaBlack = false;
+unsigned long transitionStartMs = 0;
+unsigned long transitionDurationMs = 0;
+unsigned long pendingFadeInMs = 0;
+bool lastNightMode = false;
+
+bool pulseEnabled = false;
+bool crossfadeEnabled = false;
+bool skipNextFrame = false;
+unsigned long lastFrameMs = 0;
+
+unsigned long animationFrames = 0;
+unsigned long animationFramesDropped = 0;
+unsigned long animationFramesOverBudget = 0;
+unsigned long animationFrameMaxUs = 0;
+unsigned long animationTransitions = 0;
+
+/*
+   HELPER FUNCTIONS
+*/
+
+unsigned long scaleColor(unsigned long color, int scale) {
+  return blendColor(0x000000, color, scale);
+}
+
+int pulseScale() {
+  // Dimmest at the start of every second
+  unsigned long phase = timekeepingValid() ? (unsigned long)(timekeepingNowMs() % 1000) : millis() % 1000;
+  float dip = (1.0 + cos(phase * (2 * PI / 1000.0))) / 2.0;
+  return 256 - (int)(ANIMATION_PULSE_DEPTH * dip);
+}
+
+void showColors(const unsigned long* colors, int scale) {
+  for (byte i = 0; i < NUM_SEGMENTS; i++) {
+    writeSegmentPixels(i, scale < 256 ? scaleColor(colors[i], scale) : colors[i]);
+  }
+  updateDisplay();
+}
+
+/*
+   ANIMATION ENGINE
+*/
+
+bool startTransition(bool brightnessOnly) {
+  if (pendingFadeInMs == 0 && !transitionRunning && (!crossfadeEnabled || brightnessOnly)) {
+    // Switch right away, the pulse (if any) carries on from the new colours
+    for (byte i = 0; i < NUM_SEGMENTS; i++) {
+      shownColors[i] = getCommittedSegmentColor(i / SEGMENTS_PER_DIGIT, i % SEGMENTS_PER_DIGIT);
+    }
+    lastNightMode = nightMode;
+    return false;
+  }
+
+  unsigned long duration = ANIMATION_CROSSFADE_MS;
+  transitionViaBlack = false;
+  if (pendingFadeInMs > 0) {
+    memset(shownColors, 0x00, sizeof(shownColors));
+    duration = pendingFadeInMs;
+    pendingFadeInMs = 0;
+  } else if (nightMode != lastNightMode) {
+    duration = ANIMATION_MODE_FADE_MS;
+    transitionViaBlack = true;
+  }
+  lastNightMode = nightMode;
+
+  // Start from what the LEDs show right now, which may be the middle of another transition
+  memcpy(fromColors, shownColors, sizeof(fromColors));
+  for (byte i = 0; i < NUM_SEGMENTS; i++) {
+    writeSegmentPixels(i, fromColors[i]);
+  }
+  transitionStartMs = millis();
+  transitionDurationMs = duration;
+  transitionRunning = true;
+  animationTransitions++;
+
+  lastFrameMs = 0;
+  schedulerRunIn(animationJobId, 0);
+  return true;
+}
+
+void animationJob() {
+  unsigned long now = millis();
+  if (lastFrameMs != 0 && now - lastFrameMs >= 2 * ANIMATION_FRAME_INTERVAL_MS) {
+    // The main loop was busy elsewhere for more than a frame
+    animationFramesDropped += (now - lastFrameMs) / ANIMATION_FRAME_INTERVAL_MS - 1;
+  }
+  lastFrameMs = now;
+  if (skipNextFrame) {
+    skipNextFrame = false;
+    animationFramesDropped++;
+    return;
+  }
+
+  unsigned long start = micros();
+  if (transitionRunning) {
+    unsigned long elapsed = now - transitionStartMs;
+    if (elapsed >= transitionDurationMs) {
+      for (byte i = 0; i < NUM_SEGMENTS; i++) {
+        shownColors[i] = getCommittedSegmentColor(i / SEGMENTS_PER_DIGIT, i % SEGMENTS_PER_DIGIT);
+      }
+      transitionRunning = false;
+    } else {
+      int progress = (elapsed << 8) / transitionDurationMs;
+      for (byte i = 0; i < NUM_SEGMENTS; i++) {
+        unsigned long to = getCommittedSegmentColor(i / SEGMENTS_PER_DIGIT, i % SEGMENTS_PER_DIGIT);
+        if (!transitionViaBlack) {
+          shownColors[i] = blendColor(fromColors[i], to, progress);
+        } else if (progress < 128) {
+          shownColors[i] = scaleColor(fromColors[i], 256 - 2 * progress);
+        } else {
+          shownColors[i] = scaleColor(to, 2 * progress - 256);
+        }
+      }
+    }
+  }
+  showColors(shownColors, pulseEnabled ? pulseScale() : 256);
+  animationFrames++;
+
+  unsigned long frameUs = micros() - start;
+  if (frameUs > animationFrameMaxUs) animationFrameMaxUs = frameUs;
+  if (frameUs > ANIMATION_FRAME_BUDGET_US) {
+    animationFramesOverBudget++;
+    skipNextFrame = true;
+  }
+  if (!transitionRunning && !pulseEnabled) schedulerDisable(animationJobId);
+}
+
+void writeAnimationStats(ChunkedResponse& out) {
+  out.printMetric(PSTR("animation_frames_total"), METRIC_COUNTER, animationFrames);
+  out.printMetric(PSTR("animation_frames_dropped_total"), METRIC_COUNTER, animationFramesDropped);
+  out.printMetric(PSTR("animation_frames_over_budget_total"), METRIC_COUNTER, animationFramesOverBudget);
+  out.printMetric(PSTR("animation_frame_max_us"), METRIC_GAUGE, animationFrameMaxUs);
+  out.printMetric(PSTR("animation_transitions_total"), METRIC_COUNTER, animationTransitions);
+}
+
+/*
+   PUBLIC FUNCTIONS
+*/
+
+void animationBegin() {
+  lastNightMode = nightMode;
+  animationJobId = schedulerAdd("animation", animationJob, ANIMATION_FRAME_INTERVAL_MS);
+  schedulerDisable(animationJobId);
+  displaySetFrameTransition(startTransition);
+  webAddStatsWriter(writeAnimationStats);
+}
+
+void animationFadeIn(unsigned long durationMs) {
+  pendingFadeInMs = durationMs;
+}
+
+void animationSetPulse(bool enabled) {
+  pulseEnabled = enabled;
+  if (enabled) {
+    lastFrameMs = 0;
+    schedulerRunIn(animationJobId, 0);
+  }
+}
+
+void animationSetCrossfade(bool enabled) {
+  crossfadeEnabled = enabled;
+}
+
+bool animationRunning() {
+  return transitionRunning;
+}
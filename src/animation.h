@@ -0,0 +1,40 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Frame-timed animations, run as a scheduler job at ANIMATION_FPS.
+   The boot fade-in always runs. With crossfades enabled, new digits are crossfaded to and
+   day/night switches fade out and back in. Every animation frame is a pixels.show() with
+   interrupts off, so crossfades are opt-in, and brightness-only changes are never faded.
+   The job is only enabled while something is moving, so an idle display costs nothing.
+*/
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <Arduino.h>
+
+#ifndef ANIMATION_FPS
+#define ANIMATION_FPS 40
+#endif
+// Above 1000 the frame interval (and COMMAND_APPLY_INTERVAL_MS) would be 0 ms and spin the scheduler
+static_assert(ANIMATION_FPS > 0 && ANIMATION_FPS <= 1000, "ANIMATION_FPS must be within 1 ... 1000");
+// A frame taking longer than this (pixel writes and show()) makes the next frame be skipped,
+// so animations can't starve the web server and MQTT
+#define ANIMATION_FRAME_BUDGET_US 5000
+#define ANIMATION_CROSSFADE_MS 300
+#define ANIMATION_MODE_FADE_MS 1200
+// How far the pulse dims the display, out of 256
+#define ANIMATION_PULSE_DEPTH 64
+
+// Registers the frame transition, the animation job and the stats writer
+void animationBegin();
+// The next committed frame fades in from black over durationMs
+void animationFadeIn(unsigned long durationMs);
+// Once per second "breathing" of the whole display, like the blinking colon of other clocks
+void animationSetPulse(bool enabled);
+// Crossfade to new digits and fade through black on day/night switches, instead of switching
+void animationSetCrossfade(bool enabled);
+bool animationRunning();
+
+#endif
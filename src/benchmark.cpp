@@ -0,0 +1,146 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "benchmark.h"
+#include "display.h"
+#include "web.h"
+
+#ifdef ARDUINO_ARCH_ESP8266
+#define BENCHMARK_UNIT "cycles"
+static inline uint32_t benchmarkNow() {
+  return ESP.getCycleCount();
+}
+#else
+#include <chrono>
+#define BENCHMARK_UNIT "ns"
+static inline uint32_t benchmarkNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+typedef void (*BenchmarkFunction)();
+
+static uint32_t benchmarkSamples[BENCHMARK_MAX_RUNS];
+static volatile unsigned long benchmarkSink;
+static const ColorMap* benchmarkColorMap;
+
+/*
+   BENCHMARKED OPERATIONS
+*/
+
+static void benchSetAllSegments() {
+  setAllSegments(SEG_BUF);
+}
+
+static void benchApplyBrightness() {
+  // One frame worth of pixels
+  unsigned long sink = 0;
+  for (unsigned int i = 0; i < NUM_LEDS; i++) {
+    sink += applyBrightness(0x00FFCC + i);
+  }
+  benchmarkSink = sink;
+}
+
+static void benchFillColors() {
+  // All segments of the display with the color map under test
+  unsigned long colors[NUM_SEGMENTS];
+  fillColors(*benchmarkColorMap, colors);
+  benchmarkSink = colors[NUM_SEGMENTS - 1];
+}
+
+static void benchGenerateSegmentColors() {
+  benchmarkSink = generateSegmentColors().length();
+}
+
+static void benchWriteRootPage() {
+  ChunkedResponse out;
+  out.beginDiscard();
+  writeRootPage(out);
+  out.end();
+  benchmarkSink = out.bytesWritten();
+}
+
+static void benchWriteState() {
+  char state[WEB_STATE_BUFFER_SIZE];
+  benchmarkSink = writeState(state, sizeof(state));
+}
+
+/*
+   HARNESS
+*/
+
+static int compareSamples(const void* a, const void* b) {
+  uint32_t sa = *(const uint32_t*)a;
+  uint32_t sb = *(const uint32_t*)b;
+  return sa < sb ? -1 : (sa > sb ? 1 : 0);
+}
+
+static void benchmark(String& json, const char* name, BenchmarkFunction fn, unsigned int runs) {
+  if (runs > BENCHMARK_MAX_RUNS) runs = BENCHMARK_MAX_RUNS;
+
+  fn(); // Warm up caches and the heap
+  for (unsigned int i = 0; i < runs; i++) {
+    uint32_t start = benchmarkNow();
+    fn();
+    benchmarkSamples[i] = benchmarkNow() - start;
+    yield();
+  }
+  qsort(benchmarkSamples, runs, sizeof(benchmarkSamples[0]), compareSamples);
+
+  char result[160];
+  snprintf(result, sizeof(result),
+           "%s{\"name\": \"%s\", \"runs\": %u, \"min\": %lu, \"median\": %lu, \"p99\": %lu}",
+           json.endsWith("[") ? "" : ", ", name, runs,
+           (unsigned long)benchmarkSamples[0],
+           (unsigned long)benchmarkSamples[runs / 2],
+           (unsigned long)benchmarkSamples[(runs * 99) / 100]);
+  json += result;
+}
+
+String runBenchmarks() {
+  // Benchmarks use the live display state, restore what they touch afterwards
+  const ColorMap* savedColorMap = curColorMap;
+  byte savedDigBuf[NUM_DIGITS], savedSegBuf[NUM_DIGITS];
+  memcpy(savedDigBuf, DIG_BUF, sizeof(savedDigBuf));
+  memcpy(savedSegBuf, SEG_BUF, sizeof(savedSegBuf));
+
+  formatInteger(DIG_BUF, 8888, NUM_DIGITS);
+  generateSegBuf(SEG_BUF, DIG_BUF);
+  updateBrightnessLUT();
+
+  String json = "{\"unit\": \"" BENCHMARK_UNIT "\", \"benchmarks\": [";
+
+  benchmark(json, "setAllSegments", benchSetAllSegments, 256);
+  benchmark(json, "applyBrightness_frame", benchApplyBrightness, 256);
+
+  // One benchmark per map type, using the first colour map of that type
+  const char* colorMapNames[NUM_COLOR_MAP_TYPES] = {
+    "fillColors_MT_DIG_POSITION", "fillColors_MT_DIG_VALUE", "fillColors_MT_SEG_POSITION", "fillColors_MT_SEG_RANDOM",
+    "fillColors_MT_GRADIENT", "fillColors_MT_SEG_PALETTE", "fillColors_MT_TIME_HUE", "fillColors_MT_RAINBOW",
+  };
+  for (byte i = 0; i < NUM_COLOR_MAPS; i++) {
+    byte type = COLOR_MAPS[i]->mapType;
+    if (colorMapNames[type]) {
+      benchmarkColorMap = COLOR_MAPS[i];
+      benchmark(json, colorMapNames[type], benchFillColors, 256);
+      colorMapNames[type] = NULL;
+    }
+  }
+
+  benchmark(json, "generateSegmentColors", benchGenerateSegmentColors, 64);
+  benchmark(json, "writeRootPage", benchWriteRootPage, 32);
+  benchmark(json, "writeState", benchWriteState, 64);
+
+  json += "]}";
+
+  curColorMap = savedColorMap;
+  memcpy(DIG_BUF, savedDigBuf, sizeof(savedDigBuf));
+  memcpy(SEG_BUF, savedSegBuf, sizeof(savedSegBuf));
+  // The pixel buffer and frame colours were overwritten, repaint the time on the next loop pass
+  // instead of showing the benchmark pattern until the minute changes
+  invalidateFrame();
+  requestUpdate();
+  return json;
+}
@@ -0,0 +1,19 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Microbenchmarks for the frame render path.
+   Timed in CPU cycles on the ESP8266 and in nanoseconds in the native build.
+*/
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <Arduino.h>
+
+#define BENCHMARK_MAX_RUNS 256
+
+// Run all benchmarks and return the results (min / median / p99 per benchmark) as JSON
+String runBenchmarks();
+
+#endif
@@ -0,0 +1,68 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "boot.h"
+#include "display.h"
+#include "timekeeping.h"
+#include "web.h"
+
+/*
+   GLOBAL VARIABLES
+*/
+
+const char* const BOOT_MILESTONE_NAMES[NUM_BOOT_MILESTONES] = {
+  "config_loaded",
+  "time_restored",
+  "first_frame",
+  "time_shown",
+  "wifi_connected",
+  "ntp_started",
+  "http_started",
+  "mqtt_started",
+  "time_synced",
+};
+
+unsigned long bootMilestoneTimes[NUM_BOOT_MILESTONES];
+bool bootMilestoneReached[NUM_BOOT_MILESTONES];
+
+/*
+   HELPER FUNCTIONS
+*/
+
+void onBootFrameCommitted() {
+  bootMark(BOOT_FIRST_FRAME);
+  if (timekeepingValid()) bootMark(BOOT_TIME_SHOWN);
+}
+
+void writeBootStats(ChunkedResponse& out) {
+  out.printMetricType(PSTR("boot_milestone_ms"), METRIC_GAUGE);
+  for (byte i = 0; i < NUM_BOOT_MILESTONES; i++) {
+    if (!bootMilestoneReached[i]) continue;
+    out.printSample(PSTR("boot_milestone_ms"), PSTR("milestone"), BOOT_MILESTONE_NAMES[i], bootMilestoneTimes[i]);
+  }
+}
+
+/*
+   PUBLIC FUNCTIONS
+*/
+
+void bootBegin() {
+  displayAddFrameListener(onBootFrameCommitted);
+  webAddStatsWriter(writeBootStats);
+}
+
+void bootMark(BootMilestone milestone) {
+  if (bootMilestoneReached[milestone]) return;
+  bootMilestoneTimes[milestone] = millis();
+  bootMilestoneReached[milestone] = true;
+}
+
+bool bootReached(BootMilestone milestone) {
+  return bootMilestoneReached[milestone];
+}
+
+unsigned long bootMilestoneMs(BootMilestone milestone) {
+  return bootMilestoneTimes[milestone];
+}
@@ -0,0 +1,38 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Boot milestones. setup() only loads the configuration and starts rendering, WiFi, NTP,
+   the web server and MQTT are brought up afterwards by a scheduler job, one stage per run.
+   The time (millis() since reset) each milestone was first reached is kept for /metrics.
+*/
+
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <Arduino.h>
+
+// How often a waiting boot stage (e.g. WiFi association) is polled
+#define BOOT_POLL_INTERVAL_MS 100
+
+enum BootMilestone {
+  BOOT_CONFIG_LOADED,
+  BOOT_TIME_RESTORED,   // Last known time restored from RTC memory
+  BOOT_FIRST_FRAME,     // Anything (lamp test, status code or time) committed to the LEDs
+  BOOT_TIME_SHOWN,      // First frame committed while the clock had a valid time
+  BOOT_WIFI_CONNECTED,
+  BOOT_NTP_STARTED,
+  BOOT_HTTP_STARTED,
+  BOOT_MQTT_STARTED,
+  BOOT_TIME_SYNCED,     // First successful NTP sync
+  NUM_BOOT_MILESTONES
+};
+
+// Registers the frame listener and the stats writer
+void bootBegin();
+// Records the milestone, only the first call for each one counts
+void bootMark(BootMilestone milestone);
+bool bootReached(BootMilestone milestone);
+unsigned long bootMilestoneMs(BootMilestone milestone);
+
+#endif
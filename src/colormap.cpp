@@ -0,0 +1,323 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "colormap.h"
+#include "display.h"
+
+/*
+   COLOUR MAPS
+*/
+
+const unsigned long cMapValuesAllWhite[4] = {
+  0xFFFFFF, // Digit 1
+  0xFFFFFF, // Digit 2
+  0xFFFFFF, // Digit 3
+  0xFFFFFF, // Digit 4
+};
+
+const unsigned long cMapValuesDigitPosition[4] = {
+  0xFF0000, // Digit 1
+  0x00FF00, // Digit 2
+  0x0000FF, // Digit 3
+  0xFFFFFF, // Digit 4
+};
+
+const unsigned long cMapValuesDefault[12] = {
+  // See SEG_CONF for mapping of indexes to values
+  0x00FF00,
+  0xFF0000,
+  0x0000FF,
+  0x00FFCC,
+  0xFF00FF,
+  0xFFFF00,
+  0x00FF80,
+  0xFF0080,
+  0xFF8000,
+  0x0080FF,
+  0x8000FF,
+  0x000000,
+};
+
+unsigned long cMapValuesCustom1[4] = {
+  0xFFFFFF, // Digit 1
+  0xFFFFFF, // Digit 2
+  0xFFFFFF, // Digit 3
+  0xFFFFFF, // Digit 4
+};
+
+unsigned long cMapValuesCustom2[4] = {
+  0xFFFFFF, // Digit 1
+  0xFFFFFF, // Digit 2
+  0xFFFFFF, // Digit 3
+  0xFFFFFF, // Digit 4
+};
+
+unsigned long cMapValuesMQTT[4] = {
+  0xFFFFFF, // Digit 1
+  0xFFFFFF, // Digit 2
+  0xFFFFFF, // Digit 3
+  0xFFFFFF, // Digit 4
+};
+
+const unsigned long cMapValuesGradient[3] = {
+  0xFF4000, // Left
+  0xFF0080,
+  0x4000FF, // Right
+};
+
+const unsigned long cMapValuesSegmentPalette[28] = {
+  // a        b         c         d         e         f         g
+  0xFF2000, 0xFF6000, 0xFF6000, 0xFF2000, 0xFF0000, 0xFF0000, 0xFF4000, // Digit 1
+  0xFFA000, 0xFFE000, 0xFFE000, 0xFFA000, 0xFF8000, 0xFF8000, 0xFFC000, // Digit 2
+  0x00C0FF, 0x0080FF, 0x0080FF, 0x00C0FF, 0x00FFFF, 0x00FFFF, 0x00E0FF, // Digit 3
+  0x4000FF, 0x0000FF, 0x0000FF, 0x4000FF, 0x8000FF, 0x8000FF, 0x2000FF, // Digit 4
+};
+
+const ColorMap cmAllWhite = {MT_DIG_POSITION, cMapValuesAllWhite, 4};
+const ColorMap cmDigitPosition = {MT_DIG_POSITION, cMapValuesDigitPosition, 4};
+const ColorMap cmDigitValue = {MT_DIG_VALUE, cMapValuesDefault, 12};
+const ColorMap cmSegmentPosition = {MT_SEG_POSITION, cMapValuesDefault, 12};
+const ColorMap cmSegmentRandom = {MT_SEG_RANDOM, cMapValuesDefault, 12};
+const ColorMap cmCustom1 = {MT_DIG_POSITION, cMapValuesCustom1, 4};
+const ColorMap cmCustom2 = {MT_DIG_POSITION, cMapValuesCustom2, 4};
+const ColorMap cmMQTT = {MT_DIG_POSITION, cMapValuesMQTT, 4};
+const ColorMap cmGradient = {MT_GRADIENT, cMapValuesGradient, 3};
+const ColorMap cmSegmentPalette = {MT_SEG_PALETTE, cMapValuesSegmentPalette, 28};
+const ColorMap cmTimeHue = {MT_TIME_HUE, NULL, 0};
+const ColorMap cmRainbow = {MT_RAINBOW, NULL, 0};
+
+const ColorMap* COLOR_MAPS[NUM_COLOR_MAPS] = {
+  &cmAllWhite,
+  &cmDigitPosition,
+  &cmDigitValue,
+  &cmSegmentPosition,
+  &cmSegmentRandom,
+  &cmCustom1,
+  &cmCustom2,
+  &cmGradient,
+  &cmSegmentPalette,
+  &cmTimeHue,
+  &cmRainbow,
+};
+
+static const char nameAllWhite[] PROGMEM = "All White";
+static const char nameDigitPosition[] PROGMEM = "Per Digit";
+static const char nameDigitValue[] PROGMEM = "Per Number";
+static const char nameSegmentPosition[] PROGMEM = "Per Segment";
+static const char nameSegmentRandom[] PROGMEM = "Segment-Level Random";
+static const char nameCustom1[] PROGMEM = "Custom 1";
+static const char nameCustom2[] PROGMEM = "Custom 2";
+static const char nameGradient[] PROGMEM = "Gradient";
+static const char nameSegmentPalette[] PROGMEM = "Segment Palette";
+static const char nameTimeHue[] PROGMEM = "Time of Day Hue";
+static const char nameRainbow[] PROGMEM = "Rainbow";
+
+const char* const COLOR_MAP_NAMES[NUM_COLOR_MAPS] = {
+  nameAllWhite,
+  nameDigitPosition,
+  nameDigitValue,
+  nameSegmentPosition,
+  nameSegmentRandom,
+  nameCustom1,
+  nameCustom2,
+  nameGradient,
+  nameSegmentPalette,
+  nameTimeHue,
+  nameRainbow,
+};
+
+// Seed of MT_SEG_RANDOM, so the assignment can be reproduced (e.g. by the web simulation)
+uint32_t colorMapSeed = 0x2545F491UL;
+
+// Horizontal position of each segment within its digit (0 = left, 1 = centre, 2 = right), see SEG_CONF
+const byte SEGMENT_COLUMN[SEGMENTS_PER_DIGIT] = {1, 0, 2, 1, 0, 2, 1};
+#define FACE_COLUMNS (NUM_DIGITS * 3)
+
+/*
+   HELPER FUNCTIONS
+*/
+
+unsigned long blendColor(unsigned long from, unsigned long to, int progress) {
+  unsigned long result = 0;
+  for (byte shift = 0; shift <= 16; shift += 8) {
+    int a = (from >> shift) & 0xFF;
+    int b = (to >> shift) & 0xFF;
+    result |= (unsigned long)(a + (((b - a) * progress) >> 8)) << shift;
+  }
+  return result;
+}
+
+// Final mix of MurmurHash3, spreads every input bit over the whole word
+uint32_t mixHash(uint32_t h) {
+  h ^= h >> 16;
+  h *= 0x85EBCA6BUL;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35UL;
+  h ^= h >> 16;
+  return h;
+}
+
+uint32_t xorshift32(uint32_t x) {
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+int minuteOfDay() {
+  int time = constrain(curTime, 0, 2359);
+  return (time / 100) * 60 + time % 100;
+}
+
+unsigned long hsvToRgb(uint16_t hue, byte saturation, byte value) {
+  // Six 255 step ramps between the primaries and secondaries
+  uint16_t h = ((uint32_t)hue * 1530UL + 32768) / 65536;
+  byte r, g, b;
+  if (h < 510) {
+    b = 0;
+    if (h < 255) { r = 255; g = h; } else { r = 510 - h; g = 255; }
+  } else if (h < 1020) {
+    r = 0;
+    if (h < 765) { g = 255; b = h - 510; } else { g = 1020 - h; b = 255; }
+  } else if (h < 1530) {
+    g = 0;
+    if (h < 1275) { r = h - 1020; b = 255; } else { r = 255; b = 1530 - h; }
+  } else {
+    r = 255; g = 0; b = 0;
+  }
+  uint16_t v1 = 1 + value;
+  uint16_t s1 = 1 + saturation;
+  byte s2 = 255 - saturation;
+  r = ((((r * s1) >> 8) + s2) * v1) >> 8;
+  g = ((((g * s1) >> 8) + s2) * v1) >> 8;
+  b = ((((b * s1) >> 8) + s2) * v1) >> 8;
+  return (unsigned long)r << 16 | (unsigned long)g << 8 | b;
+}
+
+/*
+   KERNELS
+*/
+
+void kernelDigitPosition(const ColorMap& cMap, unsigned long* colors) {
+  for (byte digit = 0; digit < NUM_DIGITS; digit++) {
+    for (byte segment = 0; segment < SEGMENTS_PER_DIGIT; segment++) {
+      *colors++ = cMap.cMap[digit];
+    }
+  }
+}
+
+void kernelDigitValue(const ColorMap& cMap, unsigned long* colors) {
+  for (byte digit = 0; digit < NUM_DIGITS; digit++) {
+    unsigned long color = cMap.cMap[DIG_BUF[digit]];
+    for (byte segment = 0; segment < SEGMENTS_PER_DIGIT; segment++) {
+      *colors++ = color;
+    }
+  }
+}
+
+void kernelSegmentPosition(const ColorMap& cMap, unsigned long* colors) {
+  for (byte digit = 0; digit < NUM_DIGITS; digit++) {
+    for (byte segment = 0; segment < SEGMENTS_PER_DIGIT; segment++) {
+      *colors++ = cMap.cMap[segment];
+    }
+  }
+}
+
+void kernelSegmentRandom(const ColorMap& cMap, unsigned long* colors) {
+  // A digit keeps its colours until its value changes (or the reshuffle interval ends), so the
+  // same inputs always give the same frame. Per digit, an xorshift32 generator is seeded from a
+  // hash of the seed, digit position, digit value and reshuffle epoch, and each segment draws
+  // one number from it, reduced to a colour index with a multiply-shift instead of a modulo.
+  uint32_t epoch = SEG_RANDOM_RESHUFFLE_MIN > 0 ? minuteOfDay() / SEG_RANDOM_RESHUFFLE_MIN : 0;
+  for (byte digit = 0; digit < NUM_DIGITS; digit++) {
+    uint32_t state = mixHash(colorMapSeed ^ (digit * 0x9E3779B9UL) ^ (DIG_BUF[digit] * 0x85EBCA6BUL) ^ (epoch * 0xC2B2AE35UL));
+    if (state == 0) state = 1;
+    for (byte segment = 0; segment < SEGMENTS_PER_DIGIT; segment++) {
+      state = xorshift32(state);
+      *colors++ = cMap.cMap[((state >> 16) * cMap.numColors) >> 16];
+    }
+  }
+}
+
+void kernelGradient(const ColorMap& cMap, unsigned long* colors) {
+  // Position along the face in 1/256 steps of the distance between two colour stops
+  unsigned int span = (cMap.numColors - 1) * 256;
+  for (byte digit = 0; digit < NUM_DIGITS; digit++) {
+    for (byte segment = 0; segment < SEGMENTS_PER_DIGIT; segment++) {
+      unsigned int column = digit * 3 + SEGMENT_COLUMN[segment];
+      unsigned int pos = column * span / (FACE_COLUMNS - 1);
+      byte stop = pos >> 8;
+      if (stop >= cMap.numColors - 1) {
+        *colors++ = cMap.cMap[cMap.numColors - 1];
+      } else {
+        *colors++ = blendColor(cMap.cMap[stop], cMap.cMap[stop + 1], pos & 0xFF);
+      }
+    }
+  }
+}
+
+void kernelSegmentPalette(const ColorMap& cMap, unsigned long* colors) {
+  for (byte i = 0; i < NUM_SEGMENTS; i++) {
+    colors[i] = cMap.cMap[i % cMap.numColors];
+  }
+}
+
+void kernelTimeHue(const ColorMap&, unsigned long* colors) {
+  unsigned long color = hsvToRgb((uint32_t)minuteOfDay() * 65536UL / 1440, 255, 255);
+  for (byte i = 0; i < NUM_SEGMENTS; i++) {
+    colors[i] = color;
+  }
+}
+
+void kernelRainbow(const ColorMap&, unsigned long* colors) {
+  // One full rainbow across the face, turning once per hour
+  uint16_t offset = (uint32_t)(minuteOfDay() % 60) * 65536UL / 60;
+  for (byte digit = 0; digit < NUM_DIGITS; digit++) {
+    for (byte segment = 0; segment < SEGMENTS_PER_DIGIT; segment++) {
+      unsigned int column = digit * 3 + SEGMENT_COLUMN[segment];
+      *colors++ = hsvToRgb(offset + column * (65536UL / FACE_COLUMNS), 255, 255);
+    }
+  }
+}
+
+// Indexed by ColorMapType
+const ColorMapKernel COLOR_MAP_KERNELS[NUM_COLOR_MAP_TYPES] = {
+  kernelDigitPosition,
+  kernelDigitValue,
+  kernelSegmentPosition,
+  kernelSegmentRandom,
+  kernelGradient,
+  kernelSegmentPalette,
+  kernelTimeHue,
+  kernelRainbow,
+};
+
+/*
+   PUBLIC FUNCTIONS
+*/
+
+const ColorMap* getColorMap(byte id) {
+  return id < NUM_COLOR_MAPS ? COLOR_MAPS[id] : &cmAllWhite;
+}
+
+ColorMapKernel getColorMapKernel(ColorMapType mapType) {
+  return mapType < NUM_COLOR_MAP_TYPES ? COLOR_MAP_KERNELS[mapType] : NULL;
+}
+
+void fillColors(const ColorMap& cMap, unsigned long* colors) {
+  ColorMapKernel kernel = getColorMapKernel(cMap.mapType);
+  if (kernel == NULL) {
+    memset(colors, 0x00, NUM_SEGMENTS * sizeof(unsigned long));
+    return;
+  }
+  kernel(cMap, colors);
+}
+
+unsigned long getColor(byte digit, byte segment, const ColorMap& cMap) {
+  // Single lookups only, the render path fills the whole display with fillColors()
+  unsigned long colors[NUM_SEGMENTS];
+  fillColors(cMap, colors);
+  return colors[digit * SEGMENTS_PER_DIGIT + segment];
+}
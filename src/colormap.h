@@ -0,0 +1,79 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Colour maps. Each map type has a kernel that fills the colours of all segments at once,
+   looked up once per frame from a table indexed by the map type.
+*/
+
+#ifndef COLORMAP_H
+#define COLORMAP_H
+
+#include <Arduino.h>
+
+/*
+   TYPEDEFS
+*/
+
+enum ColorMapType {
+  MT_DIG_POSITION,  // Color for each possible digit position
+  MT_DIG_VALUE,     // Color for each possible digit value
+  MT_SEG_POSITION,  // Color for each possible segment position
+  MT_SEG_RANDOM,    // (Pseudo-)Random choice for each segment
+  MT_GRADIENT,      // Horizontal gradient across the face between the colors
+  MT_SEG_PALETTE,   // Color for each individual segment of the display
+  MT_TIME_HUE,      // Hue cycling once a day with the time, no colors needed
+  MT_RAINBOW,       // HSV rainbow across the face, shifting with the time, no colors needed
+  NUM_COLOR_MAP_TYPES
+};
+
+struct ColorMap {
+  ColorMapType mapType;
+  const unsigned long* cMap;
+  byte numColors;
+};
+
+// Fills colors (NUM_SEGMENTS entries, digit * SEGMENTS_PER_DIGIT + segment) for the whole display
+typedef void (*ColorMapKernel)(const ColorMap& cMap, unsigned long* colors);
+
+/*
+   CONSTANTS
+*/
+
+#define NUM_COLOR_MAPS 11
+
+// MT_SEG_RANDOM picks new colours for all digits every this many minutes, 0 = only when a digit changes.
+// A build flag, see settings.template.h.
+#ifndef SEG_RANDOM_RESHUFFLE_MIN
+#define SEG_RANDOM_RESHUFFLE_MIN 0
+#endif
+
+/*
+   GLOBAL VARIABLES
+*/
+
+extern unsigned long cMapValuesCustom1[4];
+extern unsigned long cMapValuesCustom2[4];
+extern unsigned long cMapValuesMQTT[4];
+extern const ColorMap cmAllWhite;
+extern const ColorMap cmMQTT;
+extern const ColorMap* COLOR_MAPS[NUM_COLOR_MAPS];
+// Names for the web interface (in PROGMEM), same order as COLOR_MAPS
+extern const char* const COLOR_MAP_NAMES[NUM_COLOR_MAPS];
+extern uint32_t colorMapSeed;
+
+/*
+   FUNCTIONS
+*/
+
+// Falls back to all white for IDs out of range (e.g. from an erased config)
+const ColorMap* getColorMap(byte id);
+ColorMapKernel getColorMapKernel(ColorMapType mapType);
+void fillColors(const ColorMap& cMap, unsigned long* colors);
+unsigned long getColor(byte digit, byte segment, const ColorMap& cMap);
+// progress 0 (from) ... 256 (to), per channel
+unsigned long blendColor(unsigned long from, unsigned long to, int progress);
+// hue 0 ... 65535 for one full turn
+unsigned long hsvToRgb(uint16_t hue, byte saturation, byte value);
+
+#endif
@@ -0,0 +1,136 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "commands.h"
+#include "colormap.h"
+#include "display.h"
+#include "scheduler.h"
+#include "web.h"
+
+/*
+   GLOBAL VARIABLES
+*/
+
+int applyJobId = -1;
+int publishJobId = -1;
+CommandPublisher commandPublisher = NULL;
+
+// Latest value received per attribute, valid while its bit is set in pendingAttributes
+byte pendingAttributes = 0;
+bool pendingOn = true;
+byte pendingBrightness = 255;
+unsigned long pendingColor = 0xFFFFFF;
+bool applyScheduled = false;
+unsigned long lastApplyMs = 0;
+
+byte unpublishedAttributes = 0;
+unsigned long firstUnpublishedMs = 0;
+
+unsigned long numCommandsReceived = 0;
+unsigned long numCommandsCoalesced = 0;
+unsigned long numCommandsApplied = 0;
+unsigned long numApplyPasses = 0;
+unsigned long numStatePublishes = 0;
+
+/*
+   HELPER FUNCTIONS
+*/
+
+void queueCommand(CommandAttribute attribute) {
+  numCommandsReceived++;
+  // A value not applied yet is simply replaced
+  if (pendingAttributes & (1 << attribute)) numCommandsCoalesced++;
+  pendingAttributes |= 1 << attribute;
+  if (applyScheduled) return;
+
+  unsigned long sinceLastApply = millis() - lastApplyMs;
+  schedulerRunIn(applyJobId, sinceLastApply >= COMMAND_APPLY_INTERVAL_MS ? 0 : COMMAND_APPLY_INTERVAL_MS - sinceLastApply);
+  applyScheduled = true;
+}
+
+void schedulePublish(byte attributes) {
+  unsigned long now = millis();
+  if (unpublishedAttributes == 0) firstUnpublishedMs = now;
+  unpublishedAttributes |= attributes;
+
+  // Every apply pushes the publish back, up to the maximum delay
+  unsigned long waitedMs = now - firstUnpublishedMs;
+  unsigned long delayMs = COMMAND_PUBLISH_DELAY_MS;
+  if (waitedMs + delayMs > COMMAND_PUBLISH_MAX_DELAY_MS) {
+    delayMs = waitedMs < COMMAND_PUBLISH_MAX_DELAY_MS ? COMMAND_PUBLISH_MAX_DELAY_MS - waitedMs : 0;
+  }
+  schedulerRunIn(publishJobId, delayMs);
+}
+
+void applyJob() {
+  applyScheduled = false;
+  lastApplyMs = millis();
+  if (pendingAttributes == 0) return;
+
+  if (pendingAttributes & (1 << CMD_ON)) {
+    mqttOnState = pendingOn;
+    numCommandsApplied++;
+  }
+  if (pendingAttributes & (1 << CMD_BRIGHTNESS)) {
+    mqttBrightness = pendingBrightness;
+    numCommandsApplied++;
+  }
+  if (pendingAttributes & (1 << CMD_COLOR)) {
+    for (byte i = 0; i < 4; i++) {
+      cMapValuesMQTT[i] = pendingColor;
+    }
+    numCommandsApplied++;
+  }
+  numApplyPasses++;
+
+  // Rendered once by the main loop, however many attributes changed
+  requestUpdate();
+  schedulePublish(pendingAttributes);
+  pendingAttributes = 0;
+}
+
+void publishJob() {
+  byte attributes = unpublishedAttributes;
+  unpublishedAttributes = 0;
+  if (attributes == 0 || commandPublisher == NULL) return;
+  commandPublisher(attributes);
+  numStatePublishes++;
+}
+
+void writeCommandStats(ChunkedResponse& out) {
+  out.printMetric(PSTR("commands_received_total"), METRIC_COUNTER, numCommandsReceived);
+  out.printMetric(PSTR("commands_coalesced_total"), METRIC_COUNTER, numCommandsCoalesced);
+  out.printMetric(PSTR("commands_applied_total"), METRIC_COUNTER, numCommandsApplied);
+  out.printMetric(PSTR("commands_apply_passes_total"), METRIC_COUNTER, numApplyPasses);
+  out.printMetric(PSTR("commands_state_publishes_total"), METRIC_COUNTER, numStatePublishes);
+}
+
+/*
+   PUBLIC FUNCTIONS
+*/
+
+void commandsBegin(CommandPublisher publisher) {
+  commandPublisher = publisher;
+  applyJobId = schedulerAdd("commands_apply", applyJob, 0);
+  schedulerDisable(applyJobId);
+  publishJobId = schedulerAdd("commands_publish", publishJob, 0);
+  schedulerDisable(publishJobId);
+  webAddStatsWriter(writeCommandStats);
+}
+
+void commandSetOn(bool on) {
+  pendingOn = on;
+  queueCommand(CMD_ON);
+}
+
+void commandSetBrightness(byte brightness) {
+  pendingBrightness = brightness;
+  queueCommand(CMD_BRIGHTNESS);
+}
+
+void commandSetColor(unsigned long color) {
+  pendingColor = color & 0xFFFFFF;
+  queueCommand(CMD_COLOR);
+}
@@ -0,0 +1,43 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Coalescing queue for remote (MQTT) commands. Only the latest value per attribute is kept,
+   pending values are applied together at most once per frame tick, and the resulting state is
+   published back in one debounced batch. A slider dragged in Home Assistant thus costs one
+   render per frame and one echo at the end instead of both for every message.
+   Only MQTT commands are queued. The HTTP setters in web.cpp apply right away: they come from
+   form posts, one per submit, so there is no stream of them to coalesce, and they change other
+   settings (day / night colour maps, brightness and times) that have no state to publish back.
+*/
+
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <Arduino.h>
+#include "animation.h"
+
+// One frame at ANIMATION_FPS
+#define COMMAND_APPLY_INTERVAL_MS (1000 / ANIMATION_FPS)
+// The state is published once no command was applied for this long...
+#define COMMAND_PUBLISH_DELAY_MS 250
+// ...but at the latest this long after the first unpublished change
+#define COMMAND_PUBLISH_MAX_DELAY_MS 1000
+
+enum CommandAttribute {
+  CMD_ON,
+  CMD_BRIGHTNESS,
+  CMD_COLOR,
+  NUM_COMMAND_ATTRIBUTES
+};
+
+// Gets a bit mask (1 << CommandAttribute) of the attributes to publish
+typedef void (*CommandPublisher)(byte attributes);
+
+// Registers the apply and publish jobs and the stats writer
+void commandsBegin(CommandPublisher publisher);
+void commandSetOn(bool on);
+void commandSetBrightness(byte brightness);
+void commandSetColor(unsigned long color);
+
+#endif
@@ -0,0 +1,250 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include <stddef.h>
+
+#include "config.h"
+#include "display.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "web.h"
+
+#ifdef ARDUINO_ARCH_ESP8266
+#include <spi_flash.h>
+extern "C" uint32_t _SPIFFS_end;
+// Same sector the EEPROM library used, so the old layout can be migrated
+#define CONFIG_SECTOR (((uint32_t)&_SPIFFS_end - 0x40200000) / SPI_FLASH_SEC_SIZE)
+#else
+#define CONFIG_SECTOR 0
+#endif
+
+#define CONFIG_SLOTS (SPI_FLASH_SEC_SIZE / sizeof(ConfigRecord))
+
+static_assert(sizeof(ConfigData) == 44, "ConfigData must not contain padding");
+static_assert(sizeof(ConfigRecord) % 4 == 0, "Flash is written in words");
+
+/*
+   GLOBAL VARIABLES
+*/
+
+int configJobId = -1;
+bool configPending = false;
+
+// Slot the next record goes to, CONFIG_SLOTS = sector full
+unsigned int configNextSlot = 0;
+uint16_t configSequence = 0;
+// Contents of the newest record in flash, to skip saves that wouldn't change anything
+ConfigData configStored;
+bool configStoredValid = false;
+
+unsigned long configSavesRequested = 0;
+unsigned long configFlashWrites = 0;
+unsigned long configFlashErases = 0;
+unsigned long configWriteLastUs = 0;
+unsigned long configWriteMaxUs = 0;
+
+/*
+   HELPER FUNCTIONS
+*/
+
+uint32_t crc32(const uint8_t* data, size_t length) {
+  uint32_t crc = 0xFFFFFFFFUL;
+  while (length--) {
+    crc ^= *data++;
+    for (byte i = 0; i < 8; i++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+uint32_t recordCrc(const ConfigRecord& record) {
+  return crc32((const uint8_t*)&record, offsetof(ConfigRecord, crc));
+}
+
+uint32_t slotOffset(unsigned int slot) {
+  return CONFIG_SECTOR * SPI_FLASH_SEC_SIZE + slot * sizeof(ConfigRecord);
+}
+
+void configFromGlobals(ConfigData& data) {
+  memset(&data, 0x00, sizeof(data));
+  for (byte i = 0; i < 4; i++) {
+    data.customColors1[i] = cMapValuesCustom1[i];
+    data.customColors2[i] = cMapValuesCustom2[i];
+  }
+  data.nightModeStartTime = nightModeStartTime;
+  data.nightModeEndTime = nightModeEndTime;
+  data.forceMode = forceMode;
+  data.ctrlSrc = ctrlSrc;
+  data.brightnessCurve = brightnessCurve;
+  data.autoBrightness = autoBrightness;
+  data.dayColorMapId = dayColorMapId;
+  data.dayBrightness = dayBrightness;
+  data.nightColorMapId = nightColorMapId;
+  data.nightBrightness = nightBrightness;
+}
+
+// HHMM as stored, 0 (the power-on default) if it isn't a time of day, like an erased 0xFFFF
+int validModeTime(int16_t time) {
+  return time >= 0 && time <= 2359 && time % 100 < 60 ? time : 0;
+}
+
+void configToGlobals(const ConfigData& data) {
+  for (byte i = 0; i < 4; i++) {
+    cMapValuesCustom1[i] = data.customColors1[i] & 0xFFFFFF;
+    cMapValuesCustom2[i] = data.customColors2[i] & 0xFFFFFF;
+  }
+  nightModeStartTime = validModeTime(data.nightModeStartTime);
+  nightModeEndTime = validModeTime(data.nightModeEndTime);
+  forceMode = data.forceMode & 0x07;
+  ctrlSrc = data.ctrlSrc == CS_MQTT ? CS_MQTT : CS_STANDALONE;
+  brightnessCurve = data.brightnessCurve == BC_GAMMA ? BC_GAMMA : BC_LINEAR;
+  autoBrightness = data.autoBrightness == 1;
+  dayColorMapId = data.dayColorMapId < NUM_COLOR_MAPS ? data.dayColorMapId : 0;
+  dayBrightness = data.dayBrightness;
+  nightColorMapId = data.nightColorMapId < NUM_COLOR_MAPS ? data.nightColorMapId : 0;
+  nightBrightness = data.nightBrightness;
+
+  dayColorMap = getColorMap(dayColorMapId);
+  nightColorMap = getColorMap(nightColorMapId);
+}
+
+uint32_t legacyReadLong(const uint8_t* legacy, int address) {
+  return (uint32_t)legacy[address] | (uint32_t)legacy[address + 1] << 8 | (uint32_t)legacy[address + 2] << 16 | (uint32_t)legacy[address + 3] << 24;
+}
+
+// The raw offsets saveConfiguration() used to write through the EEPROM library
+bool configReadLegacy(ConfigData& data) {
+  uint32_t words[20];
+  uint8_t* legacy = (uint8_t*)words;
+  if (!ESP.flashRead(slotOffset(0), words, sizeof(words))) return false;
+  bool erased = true;
+  for (byte i = 0; i < sizeof(words) / 4; i++) {
+    if (words[i] != 0xFFFFFFFFUL) erased = false;
+  }
+  if (erased || words[0] == CONFIG_MAGIC) return false;
+
+  configFromGlobals(data);
+  data.nightModeStartTime = legacy[0] | legacy[1] << 8;
+  data.nightModeEndTime = legacy[2] | legacy[3] << 8;
+  data.forceMode = legacy[4];
+  data.ctrlSrc = legacy[5];
+  data.brightnessCurve = legacy[6];
+  data.autoBrightness = legacy[7];
+  data.dayColorMapId = legacy[10];
+  data.dayBrightness = legacy[11];
+  data.nightColorMapId = legacy[20];
+  data.nightBrightness = legacy[21];
+  for (byte i = 0; i < 4; i++) {
+    data.customColors1[i] = legacyReadLong(legacy, 30 + i * 4);
+    data.customColors2[i] = legacyReadLong(legacy, 60 + i * 4);
+  }
+  return true;
+}
+
+bool configWriteRecord(const ConfigData& data) {
+  TRACE_SCOPE(TRACE_CONFIG_WRITE, configNextSlot);
+  unsigned long start = micros();
+  if (configNextSlot >= CONFIG_SLOTS) {
+    if (!ESP.flashEraseSector(CONFIG_SECTOR)) return false;
+    configFlashErases++;
+    configNextSlot = 0;
+  }
+
+  ConfigRecord record;
+  record.magic = CONFIG_MAGIC;
+  record.version = CONFIG_VERSION;
+  record.sequence = ++configSequence;
+  record.data = data;
+  record.crc = recordCrc(record);
+  bool ok = ESP.flashWrite(slotOffset(configNextSlot), (uint32_t*)&record, sizeof(record));
+  // A failed write leaves a broken record behind, which is skipped when loading
+  configNextSlot++;
+  if (!ok) return false;
+
+  configStored = data;
+  configStoredValid = true;
+  configFlashWrites++;
+  configWriteLastUs = micros() - start;
+  if (configWriteLastUs > configWriteMaxUs) configWriteMaxUs = configWriteLastUs;
+  return true;
+}
+
+void configCommitJob() {
+  configFlush();
+}
+
+void writeConfigStats(ChunkedResponse& out) {
+  out.printMetric(PSTR("config_saves_requested_total"), METRIC_COUNTER, configSavesRequested);
+  out.printMetric(PSTR("config_flash_writes_total"), METRIC_COUNTER, configFlashWrites);
+  out.printMetric(PSTR("config_flash_erases_total"), METRIC_COUNTER, configFlashErases);
+  out.printMetric(PSTR("config_write_last_us"), METRIC_GAUGE, configWriteLastUs);
+  out.printMetric(PSTR("config_write_max_us"), METRIC_GAUGE, configWriteMaxUs);
+  out.printMetric(PSTR("config_log_slot"), METRIC_GAUGE, configNextSlot);
+  out.printMetric(PSTR("config_log_slots"), METRIC_GAUGE, CONFIG_SLOTS);
+}
+
+/*
+   CONFIGURATION SAVE & RECALL
+*/
+
+void configBegin() {
+  configJobId = schedulerAdd("config_commit", configCommitJob, 0);
+  schedulerDisable(configJobId);
+  webAddStatsWriter(writeConfigStats);
+}
+
+void saveConfiguration() {
+  // Every call pushes the commit back, so only the last of a burst of changes is written
+  TRACE_INSTANT(TRACE_SAVE_CONFIG, 0);
+  configSavesRequested++;
+  configPending = true;
+  schedulerRunIn(configJobId, CONFIG_COMMIT_DELAY_MS);
+}
+
+void configFlush() {
+  if (!configPending) return;
+  configPending = false;
+  schedulerDisable(configJobId);
+
+  ConfigData data;
+  configFromGlobals(data);
+  if (configStoredValid && memcmp(&data, &configStored, sizeof(data)) == 0) return;
+  configWriteRecord(data);
+}
+
+void loadConfiguration() {
+  // Walk the log up to the first empty slot, the last valid record is the newest
+  ConfigRecord record;
+  ConfigData data;
+  bool found = false;
+  configNextSlot = CONFIG_SLOTS;
+  for (unsigned int slot = 0; slot < CONFIG_SLOTS; slot++) {
+    if (!ESP.flashRead(slotOffset(slot), (uint32_t*)&record, sizeof(record))) break;
+    if (record.magic == 0xFFFFFFFFUL) {
+      configNextSlot = slot;
+      break;
+    }
+    if (record.magic != CONFIG_MAGIC || record.version != CONFIG_VERSION || record.crc != recordCrc(record)) continue;
+    data = record.data;
+    configSequence = record.sequence;
+    found = true;
+  }
+
+  if (found) {
+    configStored = data;
+    configStoredValid = true;
+  } else if (configReadLegacy(data)) {
+    // Old EEPROM layout, convert it to a record at the start of a freshly erased sector
+    configToGlobals(data);
+    configFromGlobals(data);
+    configNextSlot = CONFIG_SLOTS;
+    configWriteRecord(data);
+  } else {
+    // Fresh device, keep the compiled-in defaults
+    configFromGlobals(data);
+  }
+  configToGlobals(data);
+}
@@ -0,0 +1,53 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Configuration store. The settings are kept as a versioned, CRC checked record that is
+   appended to a log in one flash sector (the one the EEPROM library used before), so the
+   sector is only erased once every CONFIG_SLOTS saves. Saves are deferred by
+   CONFIG_COMMIT_DELAY_MS and coalesced, a burst of changes results in one flash write.
+*/
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <Arduino.h>
+
+#define CONFIG_MAGIC 0x43474643UL  // "CFGC"
+#define CONFIG_VERSION 1
+#define CONFIG_COMMIT_DELAY_MS 5000
+
+// Field order avoids padding, see the static_asserts in config.cpp
+struct ConfigData {
+  uint32_t customColors1[4];
+  uint32_t customColors2[4];
+  int16_t nightModeStartTime;
+  int16_t nightModeEndTime;
+  uint8_t forceMode;
+  uint8_t ctrlSrc;
+  uint8_t brightnessCurve;
+  uint8_t autoBrightness;
+  uint8_t dayColorMapId;
+  uint8_t dayBrightness;
+  uint8_t nightColorMapId;
+  uint8_t nightBrightness;
+};
+
+struct ConfigRecord {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t sequence;
+  ConfigData data;
+  uint32_t crc;  // CRC-32 of everything before it
+};
+
+// Registers the commit job and the stats writer
+void configBegin();
+// Schedules a (coalesced) save of the current settings
+void saveConfiguration();
+// Writes a pending save right away, e.g. before an OTA update reboots the clock
+void configFlush();
+// Loads the newest valid record, migrates the old EEPROM layout or falls back to defaults
+void loadConfiguration();
+
+#endif
@@ -0,0 +1,407 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "display.h"
+#include "hash.h"
+#include "trace.h"
+
+#include <assert.h>
+
+/*
+   SEGMENT MAPPING
+*/
+
+// Mapping of indexes to segment combinations. This is the link between SEG_BUF and DIG_BUF.
+const byte SEG_CONF[12] = {
+  //            ID  Val
+  0b1110111, // 0   0
+  0b0100100, // 1   1
+  0b1011101, // 2   2
+  0b1101101, // 3   3
+  0b0101110, // 4   4
+  0b1101011, // 5   5
+  0b1111011, // 6   6
+  0b0100101, // 7   7
+  0b1111111, // 8   8
+  0b1101111, // 9   9
+  0b0001000, // 10  -
+  0b0000000, // 11  [Off]
+};
+
+/*
+   GLOBAL VARIABLES
+*/
+
+Adafruit_NeoPixel pixels = Adafruit_NeoPixel(NUM_LEDS, DATA_PIN, PIXEL_TYPE);
+
+// HIGH LEVEL INTERFACE TO DISPLAY CONTENTS
+// Current digit values. Similar to SEG_BUF, but contains the index of the value displayed.
+// (e.g. 0-9 are the digits 0-9, 10 is a - sign etc.
+// This way, you don't have to map all 128 possible segment combinations for a value-based color map,
+// but only a subset that makes sense.
+byte DIG_BUF[NUM_DIGITS] = {11, 11, 11, 11};
+
+// LOW LEVEL INTERFACE TO DISPLAY CONTENTS
+// Current segment buffer. Contains the bit combinations of the active segments.
+byte SEG_BUF[NUM_DIGITS] = {0x00, 0x00, 0x00, 0x00};
+
+// The current time
+int curTime = 0;
+
+// Set when settings changed outside of updateAll(), e.g. from the web interface
+bool updateRequested = false;
+
+// RENDER STATE
+// Snapshot of everything a frame depends on. If nothing in here changed since the last
+// committed frame, the pixel rewrite and the (interrupt-blocking) pixels.show() are skipped.
+struct FrameState {
+  byte digBuf[NUM_DIGITS];
+  byte segBuf[NUM_DIGITS];
+  const ColorMap* colorMap;
+  unsigned long colorMapHash;
+  byte brightness;
+  BrightnessCurve brightnessCurve;
+};
+
+FrameState committedFrame;
+bool committedFrameValid = false;
+unsigned long framesCommitted = 0;
+unsigned long framesSkipped = 0;
+unsigned long frameListenersDropped = 0;
+unsigned long showCount = 0;
+unsigned long showTotalUs = 0;
+unsigned long showMaxUs = 0;
+
+FrameListener frameListeners[DISPLAY_MAX_FRAME_LISTENERS];
+byte numFrameListeners = 0;
+FrameTransition frameTransition = NULL;
+
+// Colour of every segment in the last committed frame, after brightness.
+// Usually what the LEDs show, unless a transition towards it is still running.
+unsigned long frameColors[NUM_SEGMENTS];
+
+// The display brightness
+byte curBrightness = 255;
+byte dayBrightness = 255;
+byte nightBrightness = 64;
+byte mqttBrightness = 255;
+BrightnessCurve brightnessCurve = BC_LINEAR;
+// Use the light sensor (ambient.cpp) instead of the day / night brightness
+bool autoBrightness = false;
+byte ambientBrightness = 255;
+
+// Per-channel scale table for curBrightness, rebuilt only when the brightness or curve changes
+byte brightnessLUT[256];
+int brightnessLUTLevel = -1;
+BrightnessCurve brightnessLUTCurve = BC_LINEAR;
+
+// The selected colormap
+byte curColorMapId = 0;
+const ColorMap* curColorMap = &cmAllWhite;
+byte dayColorMapId = 0;
+const ColorMap* dayColorMap = &cmAllWhite;
+byte nightColorMapId = 0;
+const ColorMap* nightColorMap = &cmAllWhite;
+
+// The current mode
+int nightModeStartTime = 0;
+int nightModeEndTime = 0;
+bool nightMode = false;
+// Bit order:
+// 0 - Forcing disabled (0) or enabled (1)
+// 1 - Force night (0) or day (1) mode
+// 2 - Force until next switch (0) or permanently (1)
+byte forceMode = 0x00;
+
+// Control source
+ControlSource ctrlSrc = CS_STANDALONE;
+
+// MQTT on/off state, applied when MQTT is the control source
+bool mqttOnState = true;
+
+/*
+   HELPER FUNCTIONS
+*/
+
+void reverseArray(unsigned long* a, int sz) {
+  int i, j;
+  for (i = 0, j = sz; i < j; i++, j--) {
+    unsigned long tmp = a[i];
+    a[i] = a[j];
+    a[j] = tmp;
+  }
+}
+
+void rotateArray(unsigned long* array, int size, int amt) {
+  if (amt < 0) amt = size + amt;
+  reverseArray(array, size - amt - 1);
+  reverseArray(array + size - amt, amt - 1);
+  reverseArray(array, size - 1);
+}
+
+bool timeInRange(int time, int rangeStart, int rangeEnd) {
+  if (rangeEnd >= rangeStart) {
+    return time >= rangeStart && time < rangeEnd;
+  } else {
+    return time >= rangeStart || time < rangeEnd;
+  }
+}
+
+void updateCurrentMode() {
+  switch(ctrlSrc) {
+    case CS_MQTT: {
+      nightMode = false;
+      curBrightness = mqttOnState ? mqttBrightness : 0;
+      curColorMap = &cmMQTT;
+      break;
+    }
+
+    default:
+    case CS_STANDALONE: {
+      bool shouldBeNightMode = timeInRange(curTime, nightModeStartTime, nightModeEndTime);
+      if (forceMode & 1) {
+        // Forcing enabled
+        nightMode = !(forceMode & 2);
+        if (!(forceMode & 4)) {
+          // Temporary forcing
+          if (nightMode == shouldBeNightMode) {
+            // Disable forcing if we are in the right time again
+            forceMode &= ~1;
+          }
+        }
+      } else {
+        // No forcing
+        nightMode = shouldBeNightMode;
+      }
+      if (autoBrightness) {
+        curBrightness = ambientBrightness;
+      } else {
+        curBrightness = nightMode ? nightBrightness : dayBrightness;
+      }
+      curColorMap = nightMode ? nightColorMap : dayColorMap;
+      curColorMapId = nightMode ? nightColorMapId : dayColorMapId;
+      break;
+    }
+  }
+}
+
+/*
+   DISPLAY RELATED FUNCTIONS
+*/
+
+void updateBrightnessLUT() {
+  if (brightnessLUTLevel == curBrightness && brightnessLUTCurve == brightnessCurve) return;
+
+  if (brightnessCurve == BC_GAMMA) {
+    // Round instead of truncating and never drop a lit channel to 0,
+    // so colours stay recognizable at low night brightness values
+    float factor = pow(curBrightness / 255.0, BRIGHTNESS_GAMMA);
+    for (int value = 0; value < 256; value++) {
+      byte scaled = value * factor + 0.5;
+      if (scaled == 0 && value > 0 && curBrightness > 0) scaled = 1;
+      brightnessLUT[value] = scaled;
+    }
+  } else {
+    // Same result as map(value * curBrightness, 0, 65025, 0, 255), since 65025 = 255 * 255
+    for (int value = 0; value < 256; value++) {
+      brightnessLUT[value] = (value * curBrightness) / 255;
+    }
+  }
+
+  brightnessLUTLevel = curBrightness;
+  brightnessLUTCurve = brightnessCurve;
+}
+
+unsigned long applyBrightness(unsigned long color) {
+  // Expects updateBrightnessLUT() to have been called for the current brightness
+  return (unsigned long)brightnessLUT[(color >> 16) & 0xFF] << 16 |
+         (unsigned long)brightnessLUT[(color >> 8) & 0xFF] << 8 |
+         brightnessLUT[color & 0xFF];
+}
+
+void writeSegmentPixels(byte index, unsigned long color) {
+  // All LEDs of a segment share one colour and are wired contiguously,
+  // so the span is written straight into the NeoPixel buffer.
+  byte red = color >> 16;
+  byte green = color >> 8;
+  byte blue = color;
+  uint8_t* pixel = pixels.getPixels() + SEG_LAYOUT::startPixel[index] * 3;
+  for (byte i = 0; i < LEDS_PER_SEGMENT; i++, pixel += 3) {
+    pixel[PIXEL_R_OFFSET] = red;
+    pixel[PIXEL_G_OFFSET] = green;
+    pixel[PIXEL_B_OFFSET] = blue;
+  }
+}
+
+void setSegmentColor(byte digit, byte segment, unsigned long color) {
+  byte index = digit * SEGMENTS_PER_DIGIT + segment;
+  color = applyBrightness(color);
+  frameColors[index] = color;
+  writeSegmentPixels(index, color);
+}
+
+void clearDisplay() {
+  pixels.clear();
+  invalidateFrame();
+}
+
+void updateDisplay() {
+  TRACE_SCOPE(TRACE_SHOW, 0);
+  unsigned long start = micros();
+  pixels.show();
+  unsigned long showUs = micros() - start;
+  showCount++;
+  showTotalUs += showUs;
+  if (showUs > showMaxUs) showMaxUs = showUs;
+}
+
+unsigned long getCommittedSegmentColor(byte digit, byte segment) {
+  // Exactly what was written for the LEDs (after brightness), not recomputed from the colour map
+  return frameColors[digit * SEGMENTS_PER_DIGIT + segment];
+}
+
+void setAllSegmentColors(unsigned long* colors) {
+  // Set each segment to the specified color
+  // Array order: abcdefg abcdefg abcdefg abcdefg
+  for (byte i = 0; i < NUM_SEGMENTS; i++) {
+    byte digit = i / SEGMENTS_PER_DIGIT;
+    byte segment = i % SEGMENTS_PER_DIGIT;
+    setSegmentColor(digit, segment, colors[i]);
+  }
+}
+
+void setAllSegments(byte* segData) {
+  // Set the segments as specified by segData using the colors specified by the color map
+  // segData bit order: 0 g f e d c b a
+  // segData order: Digit1 Digit2 Digit3 Digit4
+  unsigned long colors[NUM_SEGMENTS];
+  fillColors(*curColorMap, colors);
+  for (byte digit = 0; digit < NUM_DIGITS; digit++) {
+    for (byte segIndex = 0; segIndex < SEGMENTS_PER_DIGIT; segIndex++) {
+      if (segData[digit] & (1 << segIndex)) {
+        setSegmentColor(digit, segIndex, colors[digit * SEGMENTS_PER_DIGIT + segIndex]);
+      } else {
+        setSegmentColor(digit, segIndex, 0x000000);
+      }
+    }
+  }
+}
+
+void formatInteger(byte* digBuf, int number, byte length) {
+  // Format an integer into a digit buffer, cutting off the higher digits if necessary
+  byte digits[4]; // 1s 10s 100s 1000s
+  bool negative = number < 0;
+  if (negative) number = -number;
+  digits[3] = (number % 10000) / 1000;
+  digits[2] = (number % 1000) / 100;
+  digits[1] = (number % 100) / 10;
+  digits[0] = number % 10;
+  if (negative) digits[length - 1] = 10; // Hyphen, see SEG_CONF
+  for (byte n = 0; n < length; n++) {
+    digBuf[length - 1 - n] = digits[n];
+  }
+}
+
+byte digitToSegments(byte digit) {
+  // Get segment configuration for a digit (0 through 9)
+  return SEG_CONF[digit];
+}
+
+void generateSegBuf(byte* segBuf, byte* digBuf) {
+  // Generate the segment buffer from the digit buffer
+  for (byte n = 0; n < 4; n++) {
+    segBuf[n] = digitToSegments(digBuf[n]);
+  }
+}
+
+unsigned long hashColorMap(const ColorMap* cMap) {
+  // Over the map type and its colour values, so edits to custom / MQTT maps are detected
+  byte mapType = cMap->mapType;
+  uint32_t hash = fnv1a(&mapType, 1);
+  for (byte i = 0; i < cMap->numColors; i++) {
+    uint32_t color = cMap->cMap[i];
+    hash = fnv1a(&color, sizeof(color), hash);
+  }
+  return hash;
+}
+
+bool sameFrame(const FrameState& a, const FrameState& b) {
+  // Field by field, the padding of the struct isn't guaranteed to match after a copy
+  return memcmp(a.digBuf, b.digBuf, sizeof(a.digBuf)) == 0 &&
+         memcmp(a.segBuf, b.segBuf, sizeof(a.segBuf)) == 0 &&
+         a.colorMap == b.colorMap &&
+         a.colorMapHash == b.colorMapHash &&
+         a.brightness == b.brightness &&
+         a.brightnessCurve == b.brightnessCurve;
+}
+
+void invalidateFrame() {
+  // Force the next renderFrame() to repaint, e.g. after the pixels were touched directly
+  committedFrameValid = false;
+}
+
+void renderFrame() {
+  // Commit DIG_BUF / SEG_BUF to the LEDs, but only if the resulting frame would differ
+  // from the one currently shown.
+  FrameState frame;
+  memcpy(frame.digBuf, DIG_BUF, sizeof(frame.digBuf));
+  memcpy(frame.segBuf, SEG_BUF, sizeof(frame.segBuf));
+  frame.colorMap = curColorMap;
+  frame.colorMapHash = hashColorMap(curColorMap);
+  frame.brightness = curBrightness;
+  frame.brightnessCurve = brightnessCurve;
+
+  if (committedFrameValid && sameFrame(frame, committedFrame)) {
+    framesSkipped++;
+    return;
+  }
+
+  FrameState previous = committedFrame;
+  previous.brightness = frame.brightness;
+  bool brightnessOnly = committedFrameValid && sameFrame(frame, previous);
+
+  updateBrightnessLUT();
+  setAllSegments(SEG_BUF);
+  if (frameTransition == NULL || !frameTransition(brightnessOnly)) updateDisplay();
+  committedFrame = frame;
+  committedFrameValid = true;
+  framesCommitted++;
+  for (byte i = 0; i < numFrameListeners; i++) {
+    frameListeners[i]();
+  }
+}
+
+bool displayAddFrameListener(FrameListener listener) {
+  assert(numFrameListeners < DISPLAY_MAX_FRAME_LISTENERS);
+  if (numFrameListeners >= DISPLAY_MAX_FRAME_LISTENERS) {
+    frameListenersDropped++;
+    return false;
+  }
+  frameListeners[numFrameListeners++] = listener;
+  return true;
+}
+
+void displaySetFrameTransition(FrameTransition transition) {
+  frameTransition = transition;
+}
+
+void displayNumber(int number) {
+  formatInteger(DIG_BUF, number, 4);
+  generateSegBuf(SEG_BUF, DIG_BUF);
+  renderFrame();
+}
+
+void requestUpdate() {
+  updateRequested = true;
+}
+
+void updateAll() {
+  TRACE_SCOPE(TRACE_UPDATE_ALL, curTime);
+  updateRequested = false;
+  updateCurrentMode();
+  formatInteger(DIG_BUF, curTime, 4);
+  generateSegBuf(SEG_BUF, DIG_BUF);
+  renderFrame();
+}
@@ -0,0 +1,171 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Display core: digit/segment buffers, brightness and rendering (colour maps are in colormap.h).
+   Only depends on Arduino.h and Adafruit_NeoPixel.h, so it also builds natively.
+*/
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <Arduino.h>
+#include <Adafruit_NeoPixel.h>
+
+#include "colormap.h"
+
+/*
+   TYPEDEFS
+*/
+
+enum BrightnessCurve {
+  BC_LINEAR,  // Channels scaled linearly with the brightness setting
+  BC_GAMMA,   // Brightness setting is perceptual (gamma corrected), dim colours keep all their channels
+};
+
+// Called after a new frame has been committed to the LEDs. Up to DISPLAY_MAX_FRAME_LISTENERS, a full
+// table asserts, with NDEBUG the listener is counted as dropped.
+typedef void (*FrameListener)();
+// Called with the new frame in the pixel buffer, before it is shown. brightnessOnly is set if
+// nothing but the brightness changed since the last committed frame.
+// Returns true if it takes over showing it (e.g. to fade towards it), false to show it right away.
+typedef bool (*FrameTransition)(bool brightnessOnly);
+
+enum ControlSource {
+  CS_STANDALONE,
+  CS_MQTT,
+};
+
+/*
+   CONSTANTS
+*/
+
+#define LDR_PIN A0
+#define DATA_PIN 13
+#define LEDS_PER_SEGMENT 3
+#define NUM_DIGITS 4
+#define SEGMENTS_PER_DIGIT 7
+#define NUM_SEGMENTS (NUM_DIGITS * SEGMENTS_PER_DIGIT)
+#define NUM_LEDS (NUM_SEGMENTS * LEDS_PER_SEGMENT)
+#define PIXEL_TYPE (NEO_GRB + NEO_KHZ800)
+#define BRIGHTNESS_GAMMA 2.2
+#define DISPLAY_MAX_FRAME_LISTENERS 4
+
+// Byte offsets of the colour channels within a pixel in the NeoPixel buffer (same decoding as the library)
+#define PIXEL_R_OFFSET ((PIXEL_TYPE >> 4) & 0x03)
+#define PIXEL_G_OFFSET ((PIXEL_TYPE >> 2) & 0x03)
+#define PIXEL_B_OFFSET (PIXEL_TYPE & 0x03)
+static_assert(((PIXEL_TYPE >> 6) & 0x03) == PIXEL_R_OFFSET, "Only 3-byte RGB pixel types are supported");
+// Byte order of the NeoPixel buffer, as reported by /frame
+#define PIXEL_ORDER_NAME "GRB"
+static_assert(PIXEL_G_OFFSET == 0 && PIXEL_R_OFFSET == 1 && PIXEL_B_OFFSET == 2, "PIXEL_ORDER_NAME doesn't match PIXEL_TYPE");
+
+// Physical wiring order of the segments within a digit
+constexpr char SEGMENT_WIRING_ORDER[] = "bacfged";
+
+/*
+   PIXEL LAYOUT
+*/
+
+// Position of a segment (0 = a ... 6 = g) in the wiring order of its digit
+constexpr byte segmentWiringPosition(byte segment, byte pos = 0) {
+  return SEGMENT_WIRING_ORDER[pos] == 'a' + segment ? pos : segmentWiringPosition(segment, pos + 1);
+}
+
+// First pixel of a segment on the strip
+constexpr uint16_t segmentStartPixel(unsigned int digit, unsigned int segment) {
+  return (digit * SEGMENTS_PER_DIGIT + segmentWiringPosition(segment)) * LEDS_PER_SEGMENT;
+}
+
+template<unsigned int... Is> struct IndexSequence {};
+template<unsigned int N, unsigned int... Is> struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, Is...> {};
+template<unsigned int... Is> struct MakeIndexSequence<0, Is...> {
+  typedef IndexSequence<Is...> type;
+};
+
+// Compile-time table mapping (digit * SEGMENTS_PER_DIGIT + segment) to the first pixel of that segment
+template<typename Seq> struct SegmentLayout;
+template<unsigned int... Is> struct SegmentLayout<IndexSequence<Is...> > {
+  static constexpr uint16_t startPixel[sizeof...(Is)] = {
+    segmentStartPixel(Is / SEGMENTS_PER_DIGIT, Is % SEGMENTS_PER_DIGIT)...
+  };
+};
+template<unsigned int... Is> constexpr uint16_t SegmentLayout<IndexSequence<Is...> >::startPixel[sizeof...(Is)];
+
+typedef SegmentLayout<MakeIndexSequence<NUM_SEGMENTS>::type> SEG_LAYOUT;
+static_assert(SEG_LAYOUT::startPixel[0] == 1 * LEDS_PER_SEGMENT, "Segment a is wired second");
+static_assert(SEG_LAYOUT::startPixel[NUM_SEGMENTS - 1] == NUM_LEDS - 3 * LEDS_PER_SEGMENT, "Segment g of the last digit is wired third to last");
+
+/*
+   GLOBAL VARIABLES
+*/
+
+extern Adafruit_NeoPixel pixels;
+
+extern byte DIG_BUF[NUM_DIGITS];
+extern byte SEG_BUF[NUM_DIGITS];
+
+extern int curTime;
+
+extern bool updateRequested;
+extern unsigned long framesCommitted;
+extern unsigned long framesSkipped;
+extern unsigned long frameListenersDropped;
+// pixels.show() calls and the time spent in them (interrupts are off for all of it)
+extern unsigned long showCount;
+extern unsigned long showTotalUs;
+extern unsigned long showMaxUs;
+
+extern byte curBrightness;
+extern byte dayBrightness;
+extern byte nightBrightness;
+extern byte mqttBrightness;
+extern BrightnessCurve brightnessCurve;
+extern bool autoBrightness;
+extern byte ambientBrightness;
+
+extern byte curColorMapId;
+extern const ColorMap* curColorMap;
+extern byte dayColorMapId;
+extern const ColorMap* dayColorMap;
+extern byte nightColorMapId;
+extern const ColorMap* nightColorMap;
+
+extern int nightModeStartTime;
+extern int nightModeEndTime;
+extern bool nightMode;
+extern byte forceMode;
+
+extern ControlSource ctrlSrc;
+
+extern bool mqttOnState;
+
+/*
+   FUNCTIONS
+*/
+
+bool timeInRange(int time, int rangeStart, int rangeEnd);
+void updateCurrentMode();
+
+void updateBrightnessLUT();
+unsigned long applyBrightness(unsigned long color);
+// Raw write of a segment (digit * SEGMENTS_PER_DIGIT + segment), no brightness applied
+void writeSegmentPixels(byte index, unsigned long color);
+void setSegmentColor(byte digit, byte segment, unsigned long color);
+void clearDisplay();
+void updateDisplay();
+void setAllSegmentColors(unsigned long* colors);
+unsigned long getCommittedSegmentColor(byte digit, byte segment);
+void setAllSegments(byte* segData);
+void formatInteger(byte* digBuf, int number, byte length);
+byte digitToSegments(byte digit);
+void generateSegBuf(byte* segBuf, byte* digBuf);
+void invalidateFrame();
+void renderFrame();
+bool displayAddFrameListener(FrameListener listener);
+void displaySetFrameTransition(FrameTransition transition);
+void displayNumber(int number);
+void requestUpdate();
+void updateAll();
+
+#endif
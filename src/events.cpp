@@ -0,0 +1,186 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include <ESP8266WiFi.h>
+
+#include "events.h"
+#include "display.h"
+#include "scheduler.h"
+#include "web.h"
+
+// "data: " + SSRRGGBB per segment + "\n\n"
+#define EVENTS_MESSAGE_SIZE (6 + NUM_SEGMENTS * 8 + 2 + 1)
+
+/*
+   GLOBAL VARIABLES
+*/
+
+struct EventClient {
+  WiFiClient client;
+  bool active;
+  bool needsFullFrame;  // Just subscribed, or missed a delta because its send buffer was full
+};
+
+EventClient eventClients[EVENTS_MAX_CLIENTS];
+
+// Segment colours as of the last message sent
+unsigned long sentColors[NUM_SEGMENTS];
+
+int keepaliveJobId = -1;
+
+unsigned long eventsMessagesSent = 0;
+unsigned long eventsBytesSent = 0;
+unsigned long eventsMessagesDropped = 0;
+
+/*
+   HELPER FUNCTIONS
+*/
+
+byte activeEventClients() {
+  byte count = 0;
+  for (byte i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+    if (eventClients[i].active) count++;
+  }
+  return count;
+}
+
+void dropEventClient(EventClient& ec) {
+  ec.client.stop();
+  ec.client = WiFiClient();
+  ec.active = false;
+}
+
+void readCommittedColors(unsigned long* colors) {
+  for (byte i = 0; i < NUM_SEGMENTS; i++) {
+    colors[i] = getCommittedSegmentColor(i / SEGMENTS_PER_DIGIT, i % SEGMENTS_PER_DIGIT);
+  }
+}
+
+// Only the segments that differ from previous, or all of them if previous is NULL.
+// Returns 0 if nothing changed.
+size_t formatMessage(char* buf, const unsigned long* colors, const unsigned long* previous) {
+  size_t length = 0;
+  memcpy(buf, "data: ", 6);
+  length += 6;
+  bool empty = true;
+  for (byte i = 0; i < NUM_SEGMENTS; i++) {
+    if (previous != NULL && colors[i] == previous[i]) continue;
+    snprintf(buf + length, 9, "%02x%06lx", i, colors[i]);
+    length += 8;
+    empty = false;
+  }
+  if (empty) return 0;
+  memcpy(buf + length, "\n\n", 3);
+  return length + 2;
+}
+
+void sendMessage(EventClient& ec, const char* message, size_t length) {
+  // Never block the main loop on a slow viewer, skip the message and resync it later instead
+  if (ec.client.availableForWrite() < length) {
+    ec.needsFullFrame = true;
+    eventsMessagesDropped++;
+    return;
+  }
+  ec.client.write((const uint8_t*)message, length);
+  ec.needsFullFrame = false;
+  eventsMessagesSent++;
+  eventsBytesSent += length;
+}
+
+/*
+   EVENT SOURCES
+*/
+
+void onFrameCommitted() {
+  // Nothing to do without viewers
+  if (activeEventClients() == 0) return;
+
+  unsigned long colors[NUM_SEGMENTS];
+  readCommittedColors(colors);
+  char delta[EVENTS_MESSAGE_SIZE];
+  size_t deltaLength = formatMessage(delta, colors, sentColors);
+  char full[EVENTS_MESSAGE_SIZE];
+  size_t fullLength = 0;
+
+  for (byte i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+    EventClient& ec = eventClients[i];
+    if (!ec.active) continue;
+    if (!ec.client.connected()) {
+      dropEventClient(ec);
+      continue;
+    }
+    if (ec.needsFullFrame) {
+      if (fullLength == 0) fullLength = formatMessage(full, colors, NULL);
+      sendMessage(ec, full, fullLength);
+    } else if (deltaLength > 0) {
+      sendMessage(ec, delta, deltaLength);
+    }
+  }
+  memcpy(sentColors, colors, sizeof(sentColors));
+}
+
+void keepaliveJob() {
+  for (byte i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+    EventClient& ec = eventClients[i];
+    if (!ec.active) continue;
+    if (!ec.client.connected()) {
+      dropEventClient(ec);
+    } else if (ec.client.availableForWrite() >= 3) {
+      ec.client.write((const uint8_t*)":\n\n", 3);
+    }
+  }
+  if (activeEventClients() == 0) schedulerDisable(keepaliveJobId);
+}
+
+void writeEventsStats(ChunkedResponse& out) {
+  out.printMetric(PSTR("events_clients"), METRIC_GAUGE, activeEventClients());
+  out.printMetric(PSTR("events_messages_total"), METRIC_COUNTER, eventsMessagesSent);
+  out.printMetric(PSTR("events_bytes_total"), METRIC_COUNTER, eventsBytesSent);
+  out.printMetric(PSTR("events_messages_dropped_total"), METRIC_COUNTER, eventsMessagesDropped);
+}
+
+/*
+   PUBLIC FUNCTIONS
+*/
+
+void eventsBegin() {
+  webOn("/events", handle_events);
+  displayAddFrameListener(onFrameCommitted);
+  keepaliveJobId = schedulerAdd("events_keepalive", keepaliveJob, EVENTS_KEEPALIVE_INTERVAL_MS, EVENTS_KEEPALIVE_INTERVAL_MS);
+  schedulerDisable(keepaliveJobId);
+  webAddStatsWriter(writeEventsStats);
+}
+
+void handle_events() {
+  EventClient* ec = NULL;
+  for (byte i = 0; i < EVENTS_MAX_CLIENTS; i++) {
+    if (eventClients[i].active && !eventClients[i].client.connected()) dropEventClient(eventClients[i]);
+    if (!eventClients[i].active && ec == NULL) ec = &eventClients[i];
+  }
+  if (ec == NULL) {
+    server.send(503, "text/plain", "Too many viewers");
+    return;
+  }
+
+  // Take over the connection. The web server drops its own reference to it once the handler
+  // returns, so the stream stays open.
+  static const char headers[] PROGMEM =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n\r\n";
+  ec->client = server.client();
+  ec->client.setNoDelay(true);
+  ec->client.write_P(headers, sizeof(headers) - 1);
+  server.releaseClient();
+  if (activeEventClients() == 0) schedulerRunIn(keepaliveJobId, EVENTS_KEEPALIVE_INTERVAL_MS);
+  ec->active = true;
+
+  unsigned long colors[NUM_SEGMENTS];
+  readCommittedColors(colors);
+  char full[EVENTS_MESSAGE_SIZE];
+  sendMessage(*ec, full, formatMessage(full, colors, NULL));
+  memcpy(sentColors, colors, sizeof(sentColors));
+}
@@ -0,0 +1,24 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Live segment colours as Server-Sent Events on /events.
+   A message is only pushed when a new frame was committed, and it only contains the
+   segments that changed: "data: " followed by SSRRGGBB (segment index, colour) per segment.
+   The first message after subscribing contains all segments.
+*/
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <Arduino.h>
+
+#define EVENTS_MAX_CLIENTS 2
+// Comment line sent to open streams, so dead clients are noticed and their slot freed
+#define EVENTS_KEEPALIVE_INTERVAL_MS 30000
+
+// Registers /events, the frame listener, the keepalive job and the stats writer
+void eventsBegin();
+void handle_events();
+
+#endif
@@ -0,0 +1,26 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   FNV-1a, for change detection and checksums (colour maps, RTC record, asset ETags).
+   Not for anything that has to withstand tampering.
+*/
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <Arduino.h>
+
+#define FNV1A_INIT 2166136261UL
+#define FNV1A_PRIME 16777619UL
+
+// Pass the previous result as hash to continue over more data
+inline uint32_t fnv1a(const void* data, size_t length, uint32_t hash = FNV1A_INIT) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * FNV1A_PRIME;
+  }
+  return hash;
+}
+
+#endif
@@ -0,0 +1,197 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "profiler.h"
+
+#ifdef ENABLE_PROFILER
+
+#include "web.h"
+
+#ifdef ARDUINO_ARCH_ESP8266
+// timer1 counts the 80 MHz APB clock (independent of the CPU clock), divided by 16 here
+#define PROFILER_TIMER_TICKS (80000000L / 16 / PROFILER_SAMPLE_HZ)
+#else
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+// Load address of the (position independent) host binary, addr2line wants file offsets
+extern char __executable_start;
+#endif
+
+/*
+   GLOBAL VARIABLES
+*/
+
+struct ProfilerBucket {
+  uintptr_t pc;  // 0 = free
+  uint32_t count;
+};
+
+ProfilerBucket profilerBuckets[PROFILER_BUCKETS];
+volatile uint32_t profilerSamples = 0;
+volatile uint32_t profilerDropped = 0;
+bool profilerRunning = false;
+
+/*
+   SAMPLING
+*/
+
+// Runs in the interrupt (signal handler), so it has to live in IRAM on the device
+void ICACHE_RAM_ATTR profilerSample(uintptr_t pc) {
+  profilerSamples++;
+  if (pc == 0) {
+    profilerDropped++;
+    return;
+  }
+  uint32_t bucket = ((uint32_t)pc * 2654435761u) >> 16;
+  for (byte probe = 0; probe < PROFILER_MAX_PROBES; probe++) {
+    ProfilerBucket& b = profilerBuckets[(bucket + probe) & (PROFILER_BUCKETS - 1)];
+    if (b.pc == pc) {
+      b.count++;
+      return;
+    }
+    if (b.pc == 0) {
+      b.pc = pc;
+      b.count = 1;
+      return;
+    }
+  }
+  profilerDropped++;
+}
+
+#ifdef ARDUINO_ARCH_ESP8266
+// timer1 is a level 1 interrupt, the interrupted instruction is in EPC1. Code that runs with
+// interrupts disabled (like the bit-banging in pixels.show()) delays the sample until they're
+// enabled again, so its time is charged to the instruction right after. The WiFi stack's own
+// interrupt handlers are never sampled, its tasks (which run between loop() passes) are.
+void ICACHE_RAM_ATTR profilerTick() {
+  uint32_t pc;
+  __asm__ __volatile__("rsr %0, epc1" : "=r"(pc));
+  profilerSample(pc);
+}
+#else
+void profilerSignal(int, siginfo_t*, void* context) {
+  const ucontext_t* uc = (const ucontext_t*)context;
+#if defined(__x86_64__)
+  profilerSample(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__aarch64__)
+  profilerSample(uc->uc_mcontext.pc);
+#else
+  profilerSample(0);
+#endif
+}
+#endif
+
+uintptr_t profilerBaseAddress() {
+#ifdef ARDUINO_ARCH_ESP8266
+  return 0;
+#else
+  return (uintptr_t)&__executable_start;
+#endif
+}
+
+/*
+   HELPER FUNCTIONS
+*/
+
+// Only while stopped
+void profilerClear() {
+  memset(profilerBuckets, 0x00, sizeof(profilerBuckets));
+  profilerSamples = 0;
+  profilerDropped = 0;
+}
+
+unsigned int profilerUsedBuckets() {
+  unsigned int used = 0;
+  for (unsigned int i = 0; i < PROFILER_BUCKETS; i++) {
+    if (profilerBuckets[i].pc != 0) used++;
+  }
+  return used;
+}
+
+void writeProfilerStats(ChunkedResponse& out) {
+  out.printMetric(PSTR("profiler_samples_total"), METRIC_COUNTER, profilerSamples);
+  out.printMetric(PSTR("profiler_samples_dropped_total"), METRIC_COUNTER, profilerDropped);
+  out.printMetric(PSTR("profiler_addresses"), METRIC_GAUGE, profilerUsedBuckets());
+}
+
+/*
+   PUBLIC FUNCTIONS
+*/
+
+void profilerBegin() {
+  webOn("/profile", handle_profile);
+  webAddStatsWriter(writeProfilerStats);
+#ifdef ARDUINO_ARCH_ESP8266
+  timer1_attachInterrupt(profilerTick);
+#else
+  struct sigaction action;
+  memset(&action, 0x00, sizeof(action));
+  action.sa_sigaction = profilerSignal;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, NULL);
+#endif
+  profilerStart();
+}
+
+void profilerStart() {
+#ifdef ARDUINO_ARCH_ESP8266
+  timer1_enable(TIM_DIV16, TIM_EDGE, TIM_LOOP);
+  timer1_write(PROFILER_TIMER_TICKS);
+#else
+  // Counts CPU time of the process, so time spent blocked isn't sampled on the host
+  struct itimerval timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = 1000000L / PROFILER_SAMPLE_HZ;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, NULL);
+#endif
+  profilerRunning = true;
+}
+
+void profilerStop() {
+#ifdef ARDUINO_ARCH_ESP8266
+  timer1_disable();
+#else
+  struct itimerval timer;
+  memset(&timer, 0x00, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, NULL);
+#endif
+  profilerRunning = false;
+}
+
+void handle_profile() {
+  // Sampling stops while dumping, so the dump doesn't show up in the profile and the buckets
+  // don't change under the loop below
+  bool wasRunning = profilerRunning;
+  profilerStop();
+
+  ChunkedResponse out;
+  out.begin(200, "text/plain");
+  char line[96];
+  snprintf(line, sizeof(line),
+           "# hz %d\n"
+           "# samples %lu\n"
+           "# dropped %lu\n"
+           "# base 0x%lx\n",
+           PROFILER_SAMPLE_HZ, (unsigned long)profilerSamples, (unsigned long)profilerDropped,
+           (unsigned long)profilerBaseAddress());
+  out.print(line);
+  for (unsigned int i = 0; i < PROFILER_BUCKETS; i++) {
+    const ProfilerBucket& b = profilerBuckets[i];
+    if (b.pc == 0) continue;
+    snprintf(line, sizeof(line), "0x%lx %lu\n", (unsigned long)b.pc, (unsigned long)b.count);
+    out.print(line);
+  }
+  out.end();
+
+  // ?reset=1 starts the next profile from here
+  if (server.hasArg("reset")) profilerClear();
+  if (wasRunning) profilerStart();
+}
+
+#endif
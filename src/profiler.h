@@ -0,0 +1,35 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Sampling profiler. A timer interrupt (SIGPROF on the host) records the interrupted program
+   counter into a fixed size histogram, /profile dumps it as "address count" lines to be
+   symbolized against the firmware ELF with tools/symbolize_profile.py. Only built with
+   -D ENABLE_PROFILER.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+#ifdef ENABLE_PROFILER
+
+// Prime, so samples don't stay in phase with work that runs every n ms. On the host the
+// kernel may round it down to its tick rate.
+#define PROFILER_SAMPLE_HZ 997
+// Distinct addresses, must be a power of two. 8 bytes each on the device.
+#define PROFILER_BUCKETS 512
+// Samples whose address finds no free bucket within this many probes are only counted as dropped
+#define PROFILER_MAX_PROBES 8
+
+// Registers /profile and the stats writer and starts sampling
+void profilerBegin();
+void profilerStart();
+void profilerStop();
+// "address count" lines, preceded by "# key value" header lines. ?reset=1 clears the histogram.
+void handle_profile();
+
+#endif
+
+#endif
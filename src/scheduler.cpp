@@ -0,0 +1,149 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "scheduler.h"
+#include "trace.h"
+
+#include <assert.h>
+
+static SchedulerJobInfo jobs[SCHEDULER_MAX_JOBS];
+static byte numJobs = 0;
+static unsigned long jobsDropped = 0;
+static unsigned long idleTotalMs = 0;
+static unsigned long lastRunUs = 0;
+static bool lastRunValid = false;
+static unsigned long loopMaxMs = 0;
+
+static const unsigned long loopBucketBoundsUs[SCHEDULER_LOOP_BUCKETS] = SCHEDULER_LOOP_BUCKETS_US;
+static unsigned long loopBucketCounts[SCHEDULER_LOOP_BUCKETS + 1];
+static uint64_t loopTotalUs = 0;
+
+static void recordLoop(unsigned long loopUs) {
+  if (loopUs / 1000 > loopMaxMs) loopMaxMs = loopUs / 1000;
+  loopTotalUs += loopUs;
+  byte bucket = 0;
+  while (bucket < SCHEDULER_LOOP_BUCKETS && loopUs > loopBucketBoundsUs[bucket]) bucket++;
+  loopBucketCounts[bucket]++;
+}
+
+static bool isDue(const SchedulerJobInfo& job, unsigned long now) {
+  // Wraparound safe as long as deadlines are less than 24 days in the future
+  return job.enabled && (long)(now - job.dueMs) >= 0;
+}
+
+int schedulerAdd(const char* name, SchedulerJob job, unsigned long intervalMs, unsigned long firstDelayMs) {
+  assert(numJobs < SCHEDULER_MAX_JOBS);
+  if (numJobs >= SCHEDULER_MAX_JOBS) {
+    jobsDropped++;
+    return -1;
+  }
+  SchedulerJobInfo& info = jobs[numJobs];
+  memset(&info, 0x00, sizeof(info));
+  info.name = name;
+  info.job = job;
+  info.intervalMs = intervalMs;
+  info.dueMs = millis() + firstDelayMs;
+  info.enabled = true;
+  return numJobs++;
+}
+
+void schedulerRunIn(int id, unsigned long delayMs) {
+  if (id < 0 || id >= numJobs) return;
+  jobs[id].dueMs = millis() + delayMs;
+  jobs[id].enabled = true;
+}
+
+void schedulerDisable(int id) {
+  if (id < 0 || id >= numJobs) return;
+  jobs[id].enabled = false;
+}
+
+unsigned long schedulerRun() {
+  // Time between two passes of the main loop (jobs included), minus the time spent idling on purpose
+  unsigned long nowUs = micros();
+  if (lastRunValid) recordLoop(nowUs - lastRunUs);
+  lastRunUs = nowUs;
+  lastRunValid = true;
+  for (byte id = 0; id < numJobs; id++) {
+    SchedulerJobInfo& job = jobs[id];
+    unsigned long now = millis();
+    if (!isDue(job, now)) continue;
+
+    unsigned long lateness = now - job.dueMs;
+    job.runs++;
+    job.latenessTotalMs += lateness;
+    if (lateness > job.latenessMaxMs) job.latenessMaxMs = lateness;
+
+    if (job.intervalMs == 0) {
+      job.enabled = false;
+    } else if (lateness >= job.intervalMs) {
+      // Missed at least one period, don't try to catch up
+      job.dueMs = now + job.intervalMs;
+    } else {
+      job.dueMs += job.intervalMs;
+    }
+
+    TRACE_POLL(TRACE_SCHEDULER_JOB, id);
+    job.job();
+  }
+  return schedulerMsToNextDeadline();
+}
+
+void schedulerIdle() {
+  unsigned long idleMs = schedulerMsToNextDeadline();
+  if (idleMs > SCHEDULER_MAX_IDLE_MS) idleMs = SCHEDULER_MAX_IDLE_MS;
+  idleTotalMs += idleMs;
+  delay(idleMs);
+  lastRunUs += idleMs * 1000;
+}
+
+unsigned long schedulerMsToNextDeadline() {
+  unsigned long now = millis();
+  unsigned long next = SCHEDULER_NO_DEADLINE;
+  for (byte id = 0; id < numJobs; id++) {
+    if (!jobs[id].enabled) continue;
+    if (isDue(jobs[id], now)) return 0;
+    unsigned long remaining = jobs[id].dueMs - now;
+    if (remaining < next) next = remaining;
+  }
+  return next;
+}
+
+byte schedulerJobCount() {
+  return numJobs;
+}
+
+unsigned long schedulerJobsDropped() {
+  return jobsDropped;
+}
+
+const SchedulerJobInfo* schedulerJobInfo(byte id) {
+  if (id >= numJobs) return NULL;
+  return &jobs[id];
+}
+
+unsigned long schedulerIdleTotalMs() {
+  return idleTotalMs;
+}
+
+unsigned long schedulerLoopMaxMs() {
+  return loopMaxMs;
+}
+
+unsigned long schedulerLoopBucketBoundUs(byte bucket) {
+  return bucket < SCHEDULER_LOOP_BUCKETS ? loopBucketBoundsUs[bucket] : (unsigned long)-1;
+}
+
+unsigned long schedulerLoopBucketCount(byte bucket) {
+  unsigned long count = 0;
+  for (byte i = 0; i <= bucket && i <= SCHEDULER_LOOP_BUCKETS; i++) {
+    count += loopBucketCounts[i];
+  }
+  return count;
+}
+
+uint64_t schedulerLoopTotalUs() {
+  return loopTotalUs;
+}
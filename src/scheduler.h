@@ -0,0 +1,61 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Deadline scheduler for periodic jobs run from loop().
+   Between deadlines the main loop idles in delay(), which lets the SDK run and the modem sleep.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+
+#define SCHEDULER_MAX_JOBS 12
+// Upper bound for idling, so the web server and OTA stay responsive
+#define SCHEDULER_MAX_IDLE_MS 10
+// Upper bounds (us) of the loop duration histogram buckets, there is an implicit +Inf bucket
+#define SCHEDULER_LOOP_BUCKETS_US {250, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000}
+#define SCHEDULER_LOOP_BUCKETS 9
+// schedulerMsToNextDeadline() while no job is enabled
+#define SCHEDULER_NO_DEADLINE ((unsigned long)-1)
+
+typedef void (*SchedulerJob)();
+
+struct SchedulerJobInfo {
+  const char* name;
+  SchedulerJob job;
+  unsigned long intervalMs;  // 0 = one-shot, the job has to reschedule itself
+  unsigned long dueMs;
+  bool enabled;
+  // Statistics
+  unsigned long runs;
+  unsigned long latenessTotalMs;
+  unsigned long latenessMaxMs;
+};
+
+// Returns the job ID. A full job table asserts, with NDEBUG it returns -1 and counts the job as dropped.
+int schedulerAdd(const char* name, SchedulerJob job, unsigned long intervalMs, unsigned long firstDelayMs = 0);
+// Set the next deadline of a job relative to now, also re-enables one-shot jobs
+void schedulerRunIn(int id, unsigned long delayMs);
+void schedulerDisable(int id);
+
+// Run all due jobs, returns the number of ms until the next deadline
+unsigned long schedulerRun();
+// Sleep until the next deadline, but at most SCHEDULER_MAX_IDLE_MS
+void schedulerIdle();
+
+unsigned long schedulerMsToNextDeadline();
+byte schedulerJobCount();
+unsigned long schedulerJobsDropped();
+const SchedulerJobInfo* schedulerJobInfo(byte id);
+unsigned long schedulerIdleTotalMs();
+// Longest pass through the main loop (excluding the idle time), i.e. the worst case job latency
+unsigned long schedulerLoopMaxMs();
+// Histogram of the main loop passes, bucket counts are cumulative like Prometheus expects.
+// Bucket SCHEDULER_LOOP_BUCKETS is +Inf, i.e. the number of passes.
+unsigned long schedulerLoopBucketBoundUs(byte bucket);
+unsigned long schedulerLoopBucketCount(byte bucket);
+uint64_t schedulerLoopTotalUs();
+
+#endif
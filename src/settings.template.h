@@ -5,7 +5,15 @@
 #define MQTT_PASSWORD "password"
 
 #define NTP_HOST "pool.ntp.org"
-#define NTP_UPDATE_INTERVAL_MS 5000
+// The NTP sync interval adapts between these limits depending on how well the local clock keeps time
+#define NTP_SYNC_INTERVAL_MIN_S 64
+#define NTP_SYNC_INTERVAL_MAX_S 14400
+
+// Let the whole display "breathe" once per second, like a blinking colon
+#define ANIMATION_PULSE false
+// Crossfade to new digits and fade through black on day/night switches. Each animation frame
+// turns interrupts off for a pixels.show(), which can cost WiFi packets.
+#define ANIMATION_CROSSFADE false
 
 // MQTT integration is like a RGB light in Home Assistant
 #define MQTT_TOPIC_SET "home/rgb_clock/set"
@@ -22,7 +30,18 @@
 #define MQTT_DISCOVERY_DEVICE_UID "rgb_clock"
 #define MQTT_DISCOVERY_DEVICE_MANUFACTURER "xatLabs"
 #define MQTT_DISCOVERY_DEVICE_DESCRIPTION "7-Segment RGB clock with WS2812 LEDs"
-#define MQTT_DISCOVERY_INTERVAL_MS 60000
+
+/*
+   Build flags. These are read by modules that don't include this file, so they only take effect
+   when set for the whole build in platformio.ini, e.g. build_flags = -D ANIMATION_FPS=25
+
+   ANIMATION_FPS             Frame rate of the fades and the pulse, 1 ... 1000 (default 40)
+   SEG_RANDOM_RESHUFFLE_MIN  "Segment-Level Random" picks new colours every this many minutes,
+                             0 = only when a digit changes (default 0)
+   AMBIENT_CURVE             Auto-brightness curve, {ADC reading, brightness} points, e.g.
+                             -D 'AMBIENT_CURVE={{0, 8}, {256, 96}, {1023, 255}}' (see ambient.h)
+   AMBIENT_INVERT            true if more light gives a lower ADC reading (default false)
+*/
 
 // Variables for Station WiFi
 const char* STA_SSID = "WiFi SSID";
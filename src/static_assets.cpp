@@ -0,0 +1,149 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "static_assets.h"
+#include "hash.h"
+#include "trace.h"
+#include "web.h"
+
+/*
+   ASSET HANDLER
+*/
+
+class StaticAssetHandler : public RequestHandler {
+  public:
+    StaticAssetHandler(const char* uri, FS& fs, const String& path, const char* contentType, const char* cacheControl, uint32_t hash)
+      : uri(uri), fs(fs), path(path), contentType(contentType), cacheControl(cacheControl),
+        requests(0), notModified(0), bytesSent(0), latencyTotalUs(0), latencyMaxUs(0) {
+      snprintf(etag, sizeof(etag), "\"%08lx\"", (unsigned long)hash);
+    }
+
+    bool canHandle(HTTPMethod method, String requestUri) override {
+      return method == HTTP_GET && requestUri == uri;
+    }
+
+    bool handle(ESP8266WebServer& server, HTTPMethod method, String requestUri) override {
+      if (!canHandle(method, requestUri)) return false;
+      TRACE_SCOPE(TRACE_WEB_HANDLER, traceRoute);
+      unsigned long start = micros();
+      requests++;
+      server.sendHeader("ETag", etag);
+      server.sendHeader("Cache-Control", cacheControl);
+      if (server.hasHeader("If-None-Match") && server.header("If-None-Match").indexOf(etag) >= 0) {
+        server.send(304);
+        notModified++;
+      } else {
+        File file = fs.open(path, "r");
+        if (!file) return false;
+        // streamFile adds Content-Encoding: gzip by itself for .gz files
+        bytesSent += server.streamFile(file, contentType);
+        file.close();
+      }
+      unsigned long latency = micros() - start;
+      latencyTotalUs += latency;
+      if (latency > latencyMaxUs) latencyMaxUs = latency;
+      return true;
+    }
+
+    const char* uri;
+    FS& fs;
+    String path;
+    const char* contentType;
+    const char* cacheControl;
+    char etag[11];
+
+    unsigned long requests;
+    unsigned long notModified;
+    unsigned long bytesSent;
+    unsigned long latencyTotalUs;
+    unsigned long latencyMaxUs;
+#ifdef ENABLE_TRACE
+    uint16_t traceRoute;
+#endif
+};
+
+StaticAssetHandler* staticAssets[STATIC_MAX_ASSETS];
+byte numStaticAssets = 0;
+
+/*
+   HELPER FUNCTIONS
+*/
+
+const char* contentTypeForPath(const char* path) {
+  const char* ext = strrchr(path, '.');
+  if (ext == NULL) return "application/octet-stream";
+  if (strcmp(ext, ".html") == 0) return "text/html";
+  if (strcmp(ext, ".css") == 0) return "text/css";
+  if (strcmp(ext, ".js") == 0) return "application/javascript";
+  if (strcmp(ext, ".svg") == 0) return "image/svg+xml";
+  if (strcmp(ext, ".ico") == 0) return "image/x-icon";
+  if (strcmp(ext, ".json") == 0) return "application/json";
+  return "application/octet-stream";
+}
+
+// FNV-1a over the stored file, so the ETag changes whenever a new filesystem image is uploaded
+uint32_t hashFile(File& file) {
+  uint8_t buf[64];
+  uint32_t hash = FNV1A_INIT;
+  int n;
+  while ((n = file.read(buf, sizeof(buf))) > 0) {
+    hash = fnv1a(buf, n, hash);
+  }
+  return hash;
+}
+
+/*
+   PUBLIC FUNCTIONS
+*/
+
+void staticAssetsBegin() {
+  static const char* headerKeys[] = {"If-None-Match"};
+  server.collectHeaders(headerKeys, 1);
+  webAddStatsWriter(writeStaticAssetStats);
+}
+
+bool staticAssetAdd(const char* uri, FS& fs, const char* path, const char* cacheControl) {
+  if (numStaticAssets >= STATIC_MAX_ASSETS) return false;
+  String storedPath = String(path) + ".gz";
+  if (!fs.exists(storedPath)) storedPath = path;
+  File file = fs.open(storedPath, "r");
+  if (!file) return false;
+  uint32_t hash = hashFile(file);
+  file.close();
+
+  StaticAssetHandler* asset = new StaticAssetHandler(uri, fs, storedPath, contentTypeForPath(path), cacheControl, hash);
+#ifdef ENABLE_TRACE
+  asset->traceRoute = webTraceRoute(uri);
+#endif
+  staticAssets[numStaticAssets++] = asset;
+  server.addHandler(asset);
+  return true;
+}
+
+void writeStaticAssetStats(ChunkedResponse& out) {
+  // Samples of a metric have to be grouped, so one pass over the assets per metric
+  out.printMetricType(PSTR("static_asset_requests_total"), METRIC_COUNTER);
+  for (byte i = 0; i < numStaticAssets; i++) {
+    out.printSample(PSTR("static_asset_requests_total"), PSTR("asset"), staticAssets[i]->uri, staticAssets[i]->requests);
+  }
+  out.printMetricType(PSTR("static_asset_not_modified_total"), METRIC_COUNTER);
+  for (byte i = 0; i < numStaticAssets; i++) {
+    out.printSample(PSTR("static_asset_not_modified_total"), PSTR("asset"), staticAssets[i]->uri, staticAssets[i]->notModified);
+  }
+  out.printMetricType(PSTR("static_asset_bytes_total"), METRIC_COUNTER);
+  for (byte i = 0; i < numStaticAssets; i++) {
+    out.printSample(PSTR("static_asset_bytes_total"), PSTR("asset"), staticAssets[i]->uri, staticAssets[i]->bytesSent);
+  }
+  out.printMetricType(PSTR("static_asset_latency_avg_us"), METRIC_GAUGE);
+  for (byte i = 0; i < numStaticAssets; i++) {
+    const StaticAssetHandler* asset = staticAssets[i];
+    out.printSample(PSTR("static_asset_latency_avg_us"), PSTR("asset"), asset->uri,
+                    asset->requests ? asset->latencyTotalUs / asset->requests : 0);
+  }
+  out.printMetricType(PSTR("static_asset_latency_max_us"), METRIC_GAUGE);
+  for (byte i = 0; i < numStaticAssets; i++) {
+    out.printSample(PSTR("static_asset_latency_max_us"), PSTR("asset"), staticAssets[i]->uri, staticAssets[i]->latencyMaxUs);
+  }
+}
@@ -0,0 +1,31 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Static files from SPIFFS, served pre-compressed (see tools/compress_data.py)
+   with a content hash ETag so unchanged assets are answered with 304 Not Modified.
+*/
+
+#ifndef STATIC_ASSETS_H
+#define STATIC_ASSETS_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+class ChunkedResponse;
+
+#define STATIC_MAX_ASSETS 8
+#define STATIC_CACHE_REVALIDATE "no-cache"
+#define STATIC_CACHE_DEFAULT "max-age=3600"
+
+// Collects the request headers needed for revalidation and registers the stats writer
+void staticAssetsBegin();
+
+// Serves <path>.gz with Content-Encoding: gzip if it exists, otherwise <path>.
+// Returns false if neither exists (or the asset table is full).
+bool staticAssetAdd(const char* uri, FS& fs, const char* path, const char* cacheControl = STATIC_CACHE_DEFAULT);
+
+// Per asset request, byte and latency counters for /metrics
+void writeStaticAssetStats(ChunkedResponse& out);
+
+#endif
@@ -0,0 +1,258 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include <stddef.h>
+
+#ifdef ARDUINO_ARCH_ESP8266
+extern "C" {
+#include <user_interface.h>
+}
+#endif
+
+#include "hash.h"
+#include "timekeeping.h"
+#include "web.h"
+
+/*
+   STATE
+*/
+
+// millis() extended to 64 bits
+static uint64_t localMs = 0;
+static uint32_t lastMillis = 0;
+
+// Epoch (ms) at a given local time, the reference everything is extrapolated from
+static bool timeValid = false;
+static uint64_t anchorEpochMs = 0;
+static uint64_t anchorLocalMs = 0;
+
+// Sample used as the start of the next drift measurement
+static uint64_t driftRefEpochMs = 0;
+static uint64_t driftRefLocalMs = 0;
+static bool driftValid = false;
+// Span weighted average of the measurements so far, and the total span (s) behind it
+static long driftEstimatePpm = 0;
+static uint32_t driftSpanS = 0;
+// What the clock is corrected by, 0 until driftSpanS reaches TIME_DRIFT_APPLY_SPAN_S
+static long driftPpm = 0;
+
+static unsigned long syncIntervalMinS = 64;
+static unsigned long syncIntervalMaxS = 14400;
+static unsigned long syncIntervalS = 64;
+static uint64_t nextSyncLocalMs = 0;
+static long lastOffsetMs = 0;
+static unsigned long syncCount = 0;
+
+static bool rtcRestored = false;
+static unsigned long rtcGapMs = 0;
+
+struct TimeRtcRecord {
+  uint32_t magic;
+  uint32_t rtcTicks;  // RTC timer when saved, counts on through soft resets unlike millis()
+  uint64_t epochMs;
+  int32_t driftEstimatePpm;
+  uint32_t driftSpanS;
+  uint32_t syncIntervalS;
+  uint32_t checksum;  // FNV-1a of everything before it
+};
+
+/*
+   HELPER FUNCTIONS
+*/
+
+static void updateLocalMs() {
+  // Unsigned subtraction is wraparound safe as long as this runs at least every 49 days
+  uint32_t now = millis();
+  localMs += (uint32_t)(now - lastMillis);
+  lastMillis = now;
+}
+
+static uint32_t rtcChecksum(const TimeRtcRecord& record) {
+  return fnv1a(&record, offsetof(TimeRtcRecord, checksum));
+}
+
+static void writeTimekeepingStats(ChunkedResponse& out) {
+  out.printMetric(PSTR("time_valid"), METRIC_GAUGE, timeValid ? 1 : 0);
+  out.printMetric(PSTR("time_syncs_total"), METRIC_COUNTER, syncCount);
+  out.printMetric(PSTR("time_sync_interval_s"), METRIC_GAUGE, syncIntervalS);
+  out.printSignedMetric(PSTR("time_last_offset_ms"), METRIC_GAUGE, lastOffsetMs);
+  out.printSignedMetric(PSTR("time_drift_ppm"), METRIC_GAUGE, driftPpm);
+  out.printSignedMetric(PSTR("time_drift_estimate_ppm"), METRIC_GAUGE, driftEstimatePpm);
+  out.printMetric(PSTR("time_drift_span_s"), METRIC_GAUGE, driftSpanS);
+  out.printMetric(PSTR("time_rtc_restored"), METRIC_GAUGE, rtcRestored ? 1 : 0);
+  out.printMetric(PSTR("time_rtc_gap_ms"), METRIC_GAUGE, rtcGapMs);
+}
+
+static void addDriftMeasurement(long measuredPpm, uint32_t spanS) {
+  if (spanS > TIME_DRIFT_MAX_SPAN_S) spanS = TIME_DRIFT_MAX_SPAN_S;
+  uint32_t weightS = driftSpanS > TIME_DRIFT_MAX_SPAN_S - spanS ? TIME_DRIFT_MAX_SPAN_S - spanS : driftSpanS;
+  driftEstimatePpm = ((int64_t)driftEstimatePpm * weightS + (int64_t)measuredPpm * spanS) / (weightS + spanS);
+  driftSpanS = weightS + spanS;
+  if (driftSpanS >= TIME_DRIFT_APPLY_SPAN_S) driftPpm = driftEstimatePpm;
+}
+
+static uint64_t correctedElapsedMs(uint64_t localElapsedMs) {
+  // driftPpm > 0 means the local clock runs slow
+  return localElapsedMs + (int64_t)localElapsedMs * driftPpm / 1000000;
+}
+
+/*
+   PUBLIC FUNCTIONS
+*/
+
+void timekeepingBegin(unsigned long minSyncIntervalS, unsigned long maxSyncIntervalS) {
+  syncIntervalMinS = minSyncIntervalS;
+  syncIntervalMaxS = maxSyncIntervalS < minSyncIntervalS ? minSyncIntervalS : maxSyncIntervalS;
+  syncIntervalS = syncIntervalMinS;
+  updateLocalMs();
+  nextSyncLocalMs = localMs;
+  webAddStatsWriter(writeTimekeepingStats);
+}
+
+void timekeepingSync(uint32_t epoch) {
+  updateLocalMs();
+  // The sample could be anywhere within that second, assume the middle
+  uint64_t sampleEpochMs = (uint64_t)epoch * 1000 + 500;
+
+  if (timeValid) {
+    lastOffsetMs = (int64_t)sampleEpochMs - (int64_t)timekeepingNowMs();
+    long absOffsetMs = lastOffsetMs < 0 ? -lastOffsetMs : lastOffsetMs;
+    if (absOffsetMs <= TIME_OFFSET_GOOD_MS) {
+      syncIntervalS = syncIntervalS * 2 > syncIntervalMaxS ? syncIntervalMaxS : syncIntervalS * 2;
+    } else if (absOffsetMs > TIME_OFFSET_BAD_MS) {
+      // Clock was set (e.g. DST switch) or something is off, start over
+      syncIntervalS = syncIntervalMinS;
+    }
+  }
+
+  uint64_t spanLocalMs = localMs - driftRefLocalMs;
+  if (!driftValid || spanLocalMs >= (uint64_t)TIME_DRIFT_MIN_SPAN_S * 1000) {
+    if (driftValid) {
+      int64_t spanEpochMs = (int64_t)sampleEpochMs - (int64_t)driftRefEpochMs;
+      long measuredPpm = (spanEpochMs - (int64_t)spanLocalMs) * 1000000 / (int64_t)spanLocalMs;
+      if (measuredPpm >= -TIME_DRIFT_MAX_PPM && measuredPpm <= TIME_DRIFT_MAX_PPM) {
+        addDriftMeasurement(measuredPpm, spanLocalMs / 1000);
+      }
+    }
+    driftRefEpochMs = sampleEpochMs;
+    driftRefLocalMs = localMs;
+    driftValid = true;
+  }
+
+  anchorEpochMs = sampleEpochMs;
+  anchorLocalMs = localMs;
+  timeValid = true;
+  syncCount++;
+  nextSyncLocalMs = localMs + (uint64_t)syncIntervalS * 1000;
+}
+
+void timekeepingSyncFailed() {
+  updateLocalMs();
+  unsigned long retryS = syncIntervalS < TIME_SYNC_RETRY_S ? syncIntervalS : TIME_SYNC_RETRY_S;
+  nextSyncLocalMs = localMs + (uint64_t)retryS * 1000;
+}
+
+void timekeepingRequestSync() {
+  updateLocalMs();
+  nextSyncLocalMs = localMs;
+}
+
+bool timekeepingSyncDue() {
+  updateLocalMs();
+  return localMs >= nextSyncLocalMs;
+}
+
+unsigned long timekeepingMsToNextSync() {
+  updateLocalMs();
+  return localMs >= nextSyncLocalMs ? 0 : nextSyncLocalMs - localMs;
+}
+
+void timekeepingSaveRtc() {
+  if (!timeValid) return;
+  TimeRtcRecord record;
+  memset(&record, 0x00, sizeof(record));
+  record.magic = TIME_RTC_MAGIC;
+  record.epochMs = timekeepingNowMs();
+  record.rtcTicks = system_get_rtc_time();
+  record.driftEstimatePpm = driftEstimatePpm;
+  record.driftSpanS = driftSpanS;
+  record.syncIntervalS = syncIntervalS;
+  record.checksum = rtcChecksum(record);
+  ESP.rtcUserMemoryWrite(TIME_RTC_BLOCK, (uint32_t*)&record, sizeof(record));
+}
+
+bool timekeepingRestoreRtc() {
+  TimeRtcRecord record;
+  if (!ESP.rtcUserMemoryRead(TIME_RTC_BLOCK, (uint32_t*)&record, sizeof(record))) return false;
+  if (record.magic != TIME_RTC_MAGIC || record.checksum != rtcChecksum(record)) return false;
+
+  // Calibration is the tick period in us as 12 bit fixed point
+  uint32_t ticks = system_get_rtc_time() - record.rtcTicks;
+  uint64_t gapMs = ((uint64_t)ticks * system_rtc_clock_cali_proc() >> 12) / 1000;
+  if (gapMs > (uint64_t)TIME_RTC_MAX_GAP_S * 1000) return false;
+
+  updateLocalMs();
+  anchorEpochMs = record.epochMs + gapMs;
+  anchorLocalMs = localMs;
+  timeValid = true;
+  if (record.driftEstimatePpm >= -TIME_DRIFT_MAX_PPM && record.driftEstimatePpm <= TIME_DRIFT_MAX_PPM) {
+    driftEstimatePpm = record.driftEstimatePpm;
+    driftSpanS = record.driftSpanS < TIME_DRIFT_MAX_SPAN_S ? record.driftSpanS : TIME_DRIFT_MAX_SPAN_S;
+    if (driftSpanS >= TIME_DRIFT_APPLY_SPAN_S) driftPpm = driftEstimatePpm;
+  }
+  syncIntervalS = constrain(record.syncIntervalS, syncIntervalMinS, syncIntervalMaxS);
+  // The time is good to well within a second, NTP only needs to confirm it eventually
+  nextSyncLocalMs = localMs + (uint64_t)syncIntervalMinS * 1000;
+  rtcRestored = true;
+  rtcGapMs = gapMs;
+  return true;
+}
+
+bool timekeepingRestored() {
+  return rtcRestored;
+}
+
+bool timekeepingValid() {
+  return timeValid;
+}
+
+uint64_t timekeepingNowMs() {
+  updateLocalMs();
+  return anchorEpochMs + correctedElapsedMs(localMs - anchorLocalMs);
+}
+
+uint32_t timekeepingNow() {
+  return timekeepingNowMs() / 1000;
+}
+
+int timekeepingClockTime() {
+  uint32_t now = timekeepingNow();
+  return ((now / 3600) % 24) * 100 + (now / 60) % 60;
+}
+
+unsigned long timekeepingMsToNextMinute() {
+  return 60000 - timekeepingNowMs() % 60000;
+}
+
+uint64_t timekeepingUptimeMs() {
+  updateLocalMs();
+  return localMs;
+}
+
+long timekeepingDriftPpm() {
+  return driftPpm;
+}
+
+long timekeepingLastOffsetMs() {
+  return lastOffsetMs;
+}
+
+unsigned long timekeepingSyncInterval() {
+  return syncIntervalS;
+}
+
+unsigned long timekeepingSyncCount() {
+  return syncCount;
+}
@@ -0,0 +1,74 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Local clock disciplined by occasional NTP samples.
+   Time is kept from millis() (extended to 64 bits, so its 49 day wraparound doesn't matter),
+   corrected for the crystal drift estimated from successive NTP samples.
+   All times are local time in seconds since 1970, as delivered by NtpClientLib.
+*/
+
+#ifndef TIMEKEEPING_H
+#define TIMEKEEPING_H
+
+#include <Arduino.h>
+
+// NTP samples only have a resolution of one second, so a drift measurement over a span is off by
+// up to 1 s / span (46 ppm at 6 h). Measurements are weighted by their span, and the estimate is
+// only applied once the spans add up to TIME_DRIFT_APPLY_SPAN_S (12 ppm at 24 h).
+#define TIME_DRIFT_MIN_SPAN_S 21600
+#define TIME_DRIFT_APPLY_SPAN_S 86400
+// Older measurements fade out beyond this total span, so the estimate follows temperature changes
+#define TIME_DRIFT_MAX_SPAN_S 604800
+#define TIME_DRIFT_MAX_PPM 500
+// Offsets (ms) below which the sync interval is doubled, and above which it is reset to the minimum.
+// NTP samples only have a resolution of one second.
+#define TIME_OFFSET_GOOD_MS 1000
+#define TIME_OFFSET_BAD_MS 2000
+// Retry interval after a failed sync
+#define TIME_SYNC_RETRY_S 16
+// RTC user memory block (4 bytes each) the clock state is kept at across resets.
+// The first 128 bytes are used by eboot for OTA update commands.
+#define TIME_RTC_BLOCK 32
+#define TIME_RTC_MAGIC 0x544B5254UL  // "TRKT"
+// The RTC timer measures the gap across a reset, but its oscillator is only roughly calibrated,
+// so the record is refreshed often enough that the gap is mostly the reboot itself
+#define TIME_RTC_SAVE_INTERVAL_MS 10000
+// A longer gap means the record is stale (or the RTC timer wrapped), don't trust it
+#define TIME_RTC_MAX_GAP_S 600
+
+// Also registers the stats writer
+void timekeepingBegin(unsigned long minSyncIntervalS, unsigned long maxSyncIntervalS);
+
+// Feed a successful NTP sample / report a failed one
+void timekeepingSync(uint32_t epoch);
+void timekeepingSyncFailed();
+// Make the next timekeepingSyncDue() return true, e.g. around DST switches
+void timekeepingRequestSync();
+bool timekeepingSyncDue();
+unsigned long timekeepingMsToNextSync();
+
+// Clock state (time, drift, sync interval) for RTC memory, so a soft reset (OTA, watchdog)
+// can show the correct time right away
+void timekeepingSaveRtc();
+// Returns false after a power-on or if the record is broken or stale. The restored time counts
+// as valid, the next sync is only due after the minimum sync interval.
+bool timekeepingRestoreRtc();
+bool timekeepingRestored();
+
+bool timekeepingValid();
+uint64_t timekeepingNowMs();
+uint32_t timekeepingNow();
+// Current time as HHMM, like curTime
+int timekeepingClockTime();
+unsigned long timekeepingMsToNextMinute();
+
+// millis() since boot, without its 49 day wraparound
+uint64_t timekeepingUptimeMs();
+
+long timekeepingDriftPpm();
+long timekeepingLastOffsetMs();
+unsigned long timekeepingSyncInterval();
+unsigned long timekeepingSyncCount();
+
+#endif
@@ -0,0 +1,114 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "trace.h"
+
+#ifdef ENABLE_TRACE
+
+#include "scheduler.h"
+#include "web.h"
+
+/*
+   GLOBAL VARIABLES
+*/
+
+TraceRecord traceBuffer[TRACE_BUFFER_SIZE];
+uint32_t traceIndex = 0;
+bool tracePaused = false;
+
+const char* const TRACE_EVENT_NAMES[NUM_TRACE_EVENTS] = {
+  "ota_handle",
+  "handle_client",
+  "web_handler",
+  "mqtt_loop",
+  "mqtt_connect",
+  "ntp_get_time",
+  "scheduler_job",
+  "update_all",
+  "show",
+  "save_config",
+  "config_write",
+};
+
+/*
+   HELPER FUNCTIONS
+*/
+
+const char* traceRecordName(const TraceRecord& record) {
+  // Jobs and web handlers are named after what ran, not just the trace point
+  if (record.event == TRACE_SCHEDULER_JOB) {
+    const SchedulerJobInfo* job = schedulerJobInfo(record.arg);
+    if (job != NULL) return job->name;
+  } else if (record.event == TRACE_WEB_HANDLER) {
+    const char* uri = webRouteUri(record.arg);
+    if (uri != NULL) return uri;
+  }
+  return record.event < NUM_TRACE_EVENTS ? TRACE_EVENT_NAMES[record.event] : "unknown";
+}
+
+// Cycle count of a record widened to 64 bits. Its ms gives the count to within the offset
+// between the two counters (taken from the first record) and their drift, the cycles within
+// that. Correct as long as those stay below half a wrap (~27 s at 80 MHz).
+int64_t traceRecordCycles(const TraceRecord& record, uint32_t cyclesPerUs, uint32_t cyclesOffset) {
+  int64_t approx = (int64_t)record.ms * cyclesPerUs * 1000 + cyclesOffset;
+  return approx + (int32_t)(record.cycles - (uint32_t)approx);
+}
+
+void writeTraceStats(ChunkedResponse& out) {
+  out.printMetric(PSTR("trace_records_total"), METRIC_COUNTER, traceIndex);
+}
+
+/*
+   PUBLIC FUNCTIONS
+*/
+
+void traceBegin() {
+  webOn("/trace", handle_trace);
+  webAddStatsWriter(writeTraceStats);
+}
+
+void handle_trace() {
+  // Nothing is recorded while dumping, so the buffer doesn't change under the loop below
+  tracePaused = true;
+  uint32_t end = traceIndex;
+  uint32_t count = end < TRACE_BUFFER_SIZE ? end : TRACE_BUFFER_SIZE;
+  uint32_t cyclesPerUs = ESP.getCpuFreqMHz();
+
+  ChunkedResponse out;
+  out.begin(200, "application/json");
+  out.print("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+  // Records aren't in time order, TRACE_POLL() scopes write their begin record only at their
+  // end, so a first pass finds the earliest one to start the timestamps at
+  uint32_t first = end - count;
+  const TraceRecord& firstRecord = traceBuffer[first & (TRACE_BUFFER_SIZE - 1)];
+  uint32_t cyclesOffset = firstRecord.cycles - firstRecord.ms * cyclesPerUs * 1000;
+  int64_t minCycles = traceRecordCycles(firstRecord, cyclesPerUs, cyclesOffset);
+  for (uint32_t i = first; i != end; i++) {
+    int64_t cycles = traceRecordCycles(traceBuffer[i & (TRACE_BUFFER_SIZE - 1)], cyclesPerUs, cyclesOffset);
+    if (cycles < minCycles) minCycles = cycles;
+  }
+
+  char line[160];
+  char number[24];
+  for (uint32_t i = first; i != end; i++) {
+    const TraceRecord& record = traceBuffer[i & (TRACE_BUFFER_SIZE - 1)];
+    // A full buffer can span hours on an idle clock, more us than 32 bits hold
+    uint64_t elapsedCycles = traceRecordCycles(record, cyclesPerUs, cyclesOffset) - minCycles;
+    uint64_t us = elapsedCycles / cyclesPerUs;
+    unsigned long ns = (unsigned long)(elapsedCycles % cyclesPerUs) * 1000 / cyclesPerUs;
+    const char* phase = record.phase == TRACE_PHASE_BEGIN ? "B" : (record.phase == TRACE_PHASE_END ? "E" : "i\",\"s\":\"t");
+    snprintf(line, sizeof(line),
+             "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%s.%03lu,\"pid\":1,\"tid\":1,\"args\":{\"arg\":%u}}",
+             i == first ? "" : ",", traceRecordName(record), phase,
+             formatUint64(number, sizeof(number), us), ns, record.arg);
+    out.print(line);
+  }
+  out.print("]}");
+  out.end();
+  tracePaused = false;
+}
+
+#endif
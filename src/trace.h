@@ -0,0 +1,121 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Event trace for finding what blocked the main loop. Trace points write a fixed size record
+   (event, CPU cycle counter, argument) into a ring buffer in RAM, /trace dumps it as Chrome
+   trace JSON (chrome://tracing, Perfetto). Only built with -D ENABLE_TRACE, otherwise the
+   trace points compile to nothing.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+enum TraceEvent {
+  TRACE_OTA_HANDLE,
+  TRACE_HANDLE_CLIENT,
+  TRACE_WEB_HANDLER,    // arg: route, see webOn()
+  TRACE_MQTT_LOOP,
+  TRACE_MQTT_CONNECT,
+  TRACE_NTP_GET_TIME,
+  TRACE_SCHEDULER_JOB,  // arg: job ID
+  TRACE_UPDATE_ALL,
+  TRACE_SHOW,
+  TRACE_SAVE_CONFIG,
+  TRACE_CONFIG_WRITE,
+  NUM_TRACE_EVENTS
+};
+
+#ifdef ENABLE_TRACE
+
+// Records, must be a power of two. 12 bytes each.
+#define TRACE_BUFFER_SIZE 512
+// Calls polled on every loop pass and scheduler jobs (some run every frame) are only recorded
+// if they took at least this long, otherwise they would flush everything else out of the
+// buffer within a second
+#define TRACE_POLL_MIN_US 1000
+#define TRACE_CYCLES_PER_US (F_CPU / 1000000L)
+
+enum TracePhase {
+  TRACE_PHASE_BEGIN,
+  TRACE_PHASE_END,
+  TRACE_PHASE_INSTANT
+};
+
+struct TraceRecord {
+  uint32_t cycles;
+  // millis() at cycles. The cycle counter wraps every ~54 s at 80 MHz, an idle clock records
+  // about once a minute, so this tells which wrap the cycles belong to.
+  uint32_t ms;
+  uint8_t event;
+  uint8_t phase;
+  uint16_t arg;
+};
+
+extern TraceRecord traceBuffer[TRACE_BUFFER_SIZE];
+extern uint32_t traceIndex;
+extern bool tracePaused;
+
+// Only called from the main loop, so claiming a slot needs no lock
+inline void traceRecordAt(uint32_t cycles, uint32_t ms, uint8_t event, uint8_t phase, uint16_t arg) {
+  if (tracePaused) return;
+  TraceRecord& record = traceBuffer[traceIndex++ & (TRACE_BUFFER_SIZE - 1)];
+  record.cycles = cycles;
+  record.ms = ms;
+  record.event = event;
+  record.phase = phase;
+  record.arg = arg;
+}
+
+inline void traceRecord(uint8_t event, uint8_t phase, uint16_t arg) {
+  traceRecordAt(ESP.getCycleCount(), millis(), event, phase, arg);
+}
+
+class TraceScope {
+  public:
+    // With minCycles, nothing is recorded unless the scope took at least that long
+    TraceScope(uint8_t event, uint16_t arg, uint32_t minCycles = 0) : event(event), arg(arg), minCycles(minCycles) {
+      start = ESP.getCycleCount();
+      startMs = millis();
+      if (minCycles == 0) traceRecordAt(start, startMs, event, TRACE_PHASE_BEGIN, arg);
+    }
+    ~TraceScope() {
+      uint32_t end = ESP.getCycleCount();
+      if (minCycles != 0) {
+        if (end - start < minCycles) return;
+        traceRecordAt(start, startMs, event, TRACE_PHASE_BEGIN, arg);
+      }
+      traceRecordAt(end, millis(), event, TRACE_PHASE_END, arg);
+    }
+
+  private:
+    uint8_t event;
+    uint16_t arg;
+    uint32_t minCycles;
+    uint32_t start;
+    uint32_t startMs;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Traces from here to the end of the enclosing block
+#define TRACE_SCOPE(event, arg) TraceScope TRACE_CONCAT(traceScope, __LINE__)(event, arg)
+// Like TRACE_SCOPE, for calls made on every loop pass or frame, see TRACE_POLL_MIN_US
+#define TRACE_POLL(event, arg) TraceScope TRACE_CONCAT(traceScope, __LINE__)(event, arg, TRACE_POLL_MIN_US * TRACE_CYCLES_PER_US)
+#define TRACE_INSTANT(event, arg) traceRecord(event, TRACE_PHASE_INSTANT, arg)
+
+// Registers /trace
+void traceBegin();
+void handle_trace();
+
+#else
+
+#define TRACE_SCOPE(event, arg) do {} while (0)
+#define TRACE_POLL(event, arg) do {} while (0)
+#define TRACE_INSTANT(event, arg) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,800 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#include "web.h"
+#include "benchmark.h"
+#include "config.h"
+#include "display.h"
+#include "scheduler.h"
+#include "timekeeping.h"
+#include "trace.h"
+
+#include <assert.h>
+
+#ifdef ARDUINO_ARCH_ESP8266
+extern "C" {
+#include <umm_malloc/umm_malloc.h>
+}
+// umm_malloc's allocation unit
+#define UMM_BLOCK_BYTES 8
+#endif
+
+/*
+   WEB SERVER
+*/
+
+WebServer server(80);
+
+void WebServer::send(int code, const char* contentType, const char* content, size_t length) {
+  setContentLength(length);
+  send(code, contentType, "");
+  sendContent(content, length);
+}
+
+void WebServer::sendContent(const char* content, size_t length) {
+#ifdef ARDUINO_ARCH_ESP8266
+  // Same framing as ESP8266WebServer::sendContent(const String&)
+  if (_chunked) {
+    char chunkSize[12];
+    snprintf(chunkSize, sizeof(chunkSize), "%x\r\n", (unsigned int)length);
+    _currentClient.write((const uint8_t*)chunkSize, strlen(chunkSize));
+  }
+  _currentClient.write((const uint8_t*)content, length);
+  if (_chunked) {
+    _currentClient.write((const uint8_t*)"\r\n", 2);
+    if (length == 0) _chunked = false;
+  }
+#else
+  sendContent_P(content, length);
+#endif
+}
+
+void WebServer::releaseClient() {
+#ifdef ARDUINO_ARCH_ESP8266
+  // The handler holds its own reference to the connection, so this doesn't close it
+  _currentClient = WiFiClient();
+#endif
+}
+
+uint32_t webHeapPeakLast = 0;
+uint32_t webHeapPeakMax = 0;
+
+StatsWriter statsWriters[WEB_MAX_STATS_WRITERS];
+byte numStatsWriters = 0;
+unsigned long statsWritersDropped = 0;
+
+bool webAddStatsWriter(StatsWriter writer) {
+  assert(numStatsWriters < WEB_MAX_STATS_WRITERS);
+  if (numStatsWriters >= WEB_MAX_STATS_WRITERS) {
+    statsWritersDropped++;
+    return false;
+  }
+  statsWriters[numStatsWriters++] = writer;
+  return true;
+}
+
+#ifdef ENABLE_TRACE
+const char* webRouteUris[WEB_MAX_ROUTES];
+byte numWebRoutes = 0;
+#endif
+
+#ifdef ENABLE_TRACE
+uint16_t webTraceRoute(const char* uri) {
+  if (numWebRoutes >= WEB_MAX_ROUTES) return WEB_MAX_ROUTES;
+  webRouteUris[numWebRoutes] = uri;
+  return numWebRoutes++;
+}
+#endif
+
+void webOn(const char* uri, ESP8266WebServer::THandlerFunction handler) {
+#ifdef ENABLE_TRACE
+  uint16_t route = webTraceRoute(uri);
+  server.on(uri, [handler, route]() {
+    TRACE_SCOPE(TRACE_WEB_HANDLER, route);
+    handler();
+  });
+#else
+  server.on(uri, handler);
+#endif
+}
+
+#ifdef ENABLE_TRACE
+const char* webRouteUri(byte route) {
+  if (route < numWebRoutes) return webRouteUris[route];
+  return NULL;
+}
+#endif
+
+/*
+   CHUNKED RESPONSES
+*/
+
+ChunkedResponse::ChunkedResponse() : length(0), total(0), discard(false), heapStart(0), heapMin(0) {
+}
+
+void ChunkedResponse::begin(int code, const char* contentType) {
+  heapStart = heapMin = ESP.getFreeHeap();
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(code, contentType, "");
+  sampleHeap();
+}
+
+void ChunkedResponse::beginDiscard() {
+  discard = true;
+  heapStart = heapMin = ESP.getFreeHeap();
+}
+
+void ChunkedResponse::print(const char* str) {
+  append(str, strlen(str), false);
+}
+
+void ChunkedResponse::print_P(PGM_P str) {
+  append(str, strlen_P(str), true);
+}
+
+void ChunkedResponse::printMetricType(PGM_P name, MetricType type) {
+  print_P(PSTR("# TYPE "));
+  print_P(name);
+  switch (type) {
+    case METRIC_COUNTER:
+      print_P(PSTR(" counter\n"));
+      break;
+    case METRIC_GAUGE:
+      print_P(PSTR(" gauge\n"));
+      break;
+    case METRIC_HISTOGRAM:
+      print_P(PSTR(" histogram\n"));
+      break;
+  }
+}
+
+void ChunkedResponse::printSample(PGM_P name, PGM_P label, const char* labelValue, unsigned long value) {
+  print_P(name);
+  if (label != NULL) {
+    print_P(PSTR("{"));
+    print_P(label);
+    print_P(PSTR("=\""));
+    print(labelValue);
+    print_P(PSTR("\"}"));
+  }
+  char number[16];
+  snprintf(number, sizeof(number), " %lu\n", value);
+  print(number);
+}
+
+void ChunkedResponse::printMetric(PGM_P name, MetricType type, unsigned long value) {
+  printMetricType(name, type);
+  printSample(name, NULL, NULL, value);
+}
+
+void ChunkedResponse::printSignedMetric(PGM_P name, MetricType type, long value) {
+  printMetricType(name, type);
+  print_P(name);
+  char number[16];
+  snprintf(number, sizeof(number), " %ld\n", value);
+  print(number);
+}
+
+void ChunkedResponse::end() {
+  flush();
+  if (!discard) {
+    // Empty chunk terminates the response
+    server.sendContent(buffer, 0);
+  }
+  webHeapPeakLast = heapStart - heapMin;
+  if (webHeapPeakLast > webHeapPeakMax) webHeapPeakMax = webHeapPeakLast;
+}
+
+size_t ChunkedResponse::bytesWritten() const {
+  return total + length;
+}
+
+void ChunkedResponse::append(const char* data, size_t dataLength, bool progmem) {
+  while (dataLength > 0) {
+    size_t n = sizeof(buffer) - length;
+    if (n > dataLength) n = dataLength;
+    if (progmem) {
+      memcpy_P(buffer + length, data, n);
+    } else {
+      memcpy(buffer + length, data, n);
+    }
+    length += n;
+    data += n;
+    dataLength -= n;
+    if (length == sizeof(buffer)) flush();
+  }
+}
+
+void ChunkedResponse::flush() {
+  if (length == 0) return;
+  if (!discard) {
+    server.sendContent(buffer, length);
+  }
+  sampleHeap();
+  total += length;
+  length = 0;
+}
+
+void ChunkedResponse::sampleHeap() {
+  uint32_t freeHeap = ESP.getFreeHeap();
+  if (freeHeap < heapMin) heapMin = freeHeap;
+}
+
+/*
+   HANDLERS
+*/
+
+void handleNotFound() {
+  String message = "File Not Found\n\n";
+  message += "URI: ";
+  message += server.uri();
+  message += "\nMethod: ";
+  message += (server.method() == HTTP_GET) ? "GET" : "POST";
+  message += "\nArguments: ";
+  message += server.args();
+  message += "\n";
+  for (uint8_t i = 0; i < server.args(); i++) {
+    message += " " + server.argName(i) + ": " + server.arg(i) + "\n";
+  }
+  server.send(404, "text/plain", message);
+}
+
+void writeColorMapSelectMenu(ChunkedResponse& out, byte colorMapId) {
+  char value[4];
+  out.print_P(PSTR("<select name='colormap'>"));
+  for (byte i = 0; i < NUM_COLOR_MAPS; i++) {
+    sprintf(value, "%i", i);
+    out.print_P(PSTR("<option value='"));
+    out.print(value);
+    out.print_P(PSTR("'"));
+    if (colorMapId == i) out.print_P(PSTR(" selected"));
+    out.print_P(PSTR(">"));
+    out.print_P(COLOR_MAP_NAMES[i]);
+    out.print_P(PSTR("</option>"));
+  }
+  out.print_P(PSTR("</select>"));
+}
+
+bool isCustomColorMap(byte colorMapId) {
+  return colorMapId == 5 || colorMapId == 6;
+}
+
+void writeCustomColorMapSettingsForm(ChunkedResponse& out, byte colorMapId, const ColorMap* colorMap) {
+  char colorFmt[7];
+  out.print_P(PSTR("<h4>Custom Colour Scheme</h4>"));
+  out.print_P(PSTR("<form action='/setcustomcolors"));
+  out.print(colorMapId == 5 ? "1" : "2");
+  out.print_P(PSTR("' method='POST'>"));
+  out.print_P(PSTR("<input type='color' name='digit1' value='#"));
+  sprintf(colorFmt, "%06lx", colorMap->cMap[0]);
+  out.print(colorFmt);
+  out.print_P(PSTR("' />"));
+  out.print_P(PSTR("<input type='color' name='digit2' value='#"));
+  sprintf(colorFmt, "%06lx", colorMap->cMap[1]);
+  out.print(colorFmt);
+  out.print_P(PSTR("' />"));
+  out.print_P(PSTR("<input type='color' name='digit3' value='#"));
+  sprintf(colorFmt, "%06lx", colorMap->cMap[2]);
+  out.print(colorFmt);
+  out.print_P(PSTR("' />"));
+  out.print_P(PSTR("<input type='color' name='digit4' value='#"));
+  sprintf(colorFmt, "%06lx", colorMap->cMap[3]);
+  out.print(colorFmt);
+  out.print_P(PSTR("' />"));
+  out.print_P(PSTR("<input type='submit' value='Set'/>"));
+  out.print_P(PSTR("</form>"));
+}
+
+void writeRootPage(ChunkedResponse& out) {
+  out.print_P(PSTR("<html>"));
+  out.print_P(PSTR("<head>"));
+  out.print_P(PSTR("<link rel='shortcut icon' href='/favicon.ico'>"));
+  out.print_P(PSTR("<meta name='viewport' content='width=device-width, initial-scale=1.0'>"));
+  out.print_P(PSTR("<link rel='stylesheet' href='/rgbclock.css'>"));
+  out.print_P(PSTR("<title>RGB Clock</title>"));
+  out.print_P(PSTR("</head>"));
+  out.print_P(PSTR("<body>"));
+  out.print_P(PSTR("<h1>RGB Clock</h1>"));
+
+  out.print_P(PSTR("<iframe class='simulation' src='/simulation.html'></iframe>"));
+
+  // Sized for any int, not just the valid HHMM values
+  char startTimeStr[24], endTimeStr[24];
+  snprintf(startTimeStr, sizeof(startTimeStr), "%02i:%02i", nightModeStartTime / 100, nightModeStartTime % 100);
+  snprintf(endTimeStr, sizeof(endTimeStr), "%02i:%02i", nightModeEndTime / 100, nightModeEndTime % 100);
+  out.print_P(PSTR("<div id='mode-settings'>"));
+  out.print_P(PSTR("<form action='/setmodetimes' method='POST'>"));
+  out.print_P(PSTR("Night mode from "));
+  out.print_P(PSTR("<input type='time' name='start' value='"));
+  out.print(startTimeStr);
+  out.print_P(PSTR("'/>"));
+  out.print_P(PSTR(" to "));
+  out.print_P(PSTR("<input type='time' name='end' value='"));
+  out.print(endTimeStr);
+  out.print_P(PSTR("'/>"));
+  out.print_P(PSTR("<input type='submit' value='Set'/>"));
+  out.print_P(PSTR("</form>"));
+  out.print_P(PSTR("</div>"));
+  out.print_P(PSTR("<div id='mode-force'>"));
+  out.print_P(PSTR("<form action='/setmodeforce' method='POST'>"));
+  out.print_P(PSTR("<label><input type='checkbox' name='force-enabled' value='true' "));
+  out.print((forceMode & 1) ? "checked" : "");
+  out.print_P(PSTR("/> Force Mode</label>"));
+  out.print_P(PSTR("<br />"));
+  out.print_P(PSTR("<label><input type='radio' name='force-which' value='day'"));
+  out.print((forceMode & 2) ? "checked" : "");
+  out.print_P(PSTR("/> Day Mode</label>"));
+  out.print_P(PSTR("<br />"));
+  out.print_P(PSTR("<label><input type='radio' name='force-which' value='night'"));
+  out.print(!(forceMode & 2) ? "checked" : "");
+  out.print_P(PSTR("/> Night Mode</label>"));
+  out.print_P(PSTR("<br />"));
+  out.print_P(PSTR("<label><input type='checkbox' name='force-permanent' value='true'"));
+  out.print((forceMode & 4) ? "checked" : "");
+  out.print_P(PSTR("/> Permanent</label>"));
+  out.print_P(PSTR("<br />"));
+  out.print_P(PSTR("<input type='submit' value='Set'/>"));
+  out.print_P(PSTR("</form>"));
+  out.print_P(PSTR("</div>"));
+
+  out.print_P(PSTR("<div id='brightness-curve'>"));
+  out.print_P(PSTR("<form action='/setbrightnesscurve' method='POST'>"));
+  out.print_P(PSTR("<label><input type='radio' name='brightness-curve' value='linear'"));
+  out.print((brightnessCurve == BC_LINEAR) ? "checked" : "");
+  out.print_P(PSTR("/> Linear Brightness</label>"));
+  out.print_P(PSTR("<br />"));
+  out.print_P(PSTR("<label><input type='radio' name='brightness-curve' value='gamma'"));
+  out.print((brightnessCurve == BC_GAMMA) ? "checked" : "");
+  out.print_P(PSTR("/> Perceptual Brightness</label>"));
+  out.print_P(PSTR("<br />"));
+  out.print_P(PSTR("<input type='submit' value='Set'/>"));
+  out.print_P(PSTR("</form>"));
+  out.print_P(PSTR("</div>"));
+
+  out.print_P(PSTR("<div id='auto-brightness'>"));
+  out.print_P(PSTR("<form action='/setautobrightness' method='POST'>"));
+  out.print_P(PSTR("<label><input type='checkbox' name='auto-brightness' value='true'"));
+  out.print(autoBrightness ? "checked" : "");
+  out.print_P(PSTR("/> Automatic Brightness (Light Sensor)</label>"));
+  out.print_P(PSTR("<br />"));
+  out.print_P(PSTR("<input type='submit' value='Set'/>"));
+  out.print_P(PSTR("</form>"));
+  out.print_P(PSTR("</div>"));
+
+  out.print_P(PSTR("<div id='ctrl-src'>"));
+  out.print_P(PSTR("<form action='/setctrlsrc' method='POST'>"));
+  out.print_P(PSTR("<label><input type='radio' name='ctrl-src' value='standalone'"));
+  out.print((ctrlSrc == CS_STANDALONE) ? "checked" : "");
+  out.print_P(PSTR("/> Internal Control</label>"));
+  out.print_P(PSTR("<br />"));
+  out.print_P(PSTR("<label><input type='radio' name='ctrl-src' value='mqtt'"));
+  out.print((ctrlSrc == CS_MQTT) ? "checked" : "");
+  out.print_P(PSTR("/> MQTT Control</label>"));
+  out.print_P(PSTR("<br />"));
+  out.print_P(PSTR("<input type='submit' value='Set'/>"));
+  out.print_P(PSTR("</form>"));
+  out.print_P(PSTR("</div>"));
+
+  out.print_P(PSTR("<hr />"));
+
+  out.print_P(PSTR("<h2>Day Settings</h2>"));
+  out.print_P(PSTR("<div id='day-settings'>"));
+  out.print_P(PSTR("<h3>Colour Scheme</h3>"));
+  out.print_P(PSTR("<form action='/setdaycolormap' method='POST'>"));
+  writeColorMapSelectMenu(out, dayColorMapId);
+  out.print_P(PSTR("<input type='submit' value='Set'/>"));
+  out.print_P(PSTR("</form>"));
+
+  if (isCustomColorMap(dayColorMapId)) {
+    writeCustomColorMapSettingsForm(out, dayColorMapId, dayColorMap);
+  }
+
+  char dayBrightnessStr[4];
+  sprintf(dayBrightnessStr, "%i", dayBrightness);
+  out.print_P(PSTR("<h3>Brightness</h3>"));
+  out.print_P(PSTR("<form action='/setdaybrightness' method='POST'>"));
+  out.print_P(PSTR("<input type='range' name='brightness' min='0' max='255' step='1' value='"));
+  out.print(dayBrightnessStr);
+  out.print_P(PSTR("'/>"));
+  out.print_P(PSTR("<input type='submit' value='Set'/>"));
+  out.print_P(PSTR("</form>"));
+  out.print_P(PSTR("</div>"));
+
+  out.print_P(PSTR("<hr />"));
+
+  out.print_P(PSTR("<h2>Night Settings</h2>"));
+  out.print_P(PSTR("<div id='night-settings'>"));
+  out.print_P(PSTR("<h3>Colour Scheme</h3>"));
+  out.print_P(PSTR("<form action='/setnightcolormap' method='POST'>"));
+  writeColorMapSelectMenu(out, nightColorMapId);
+  out.print_P(PSTR("<input type='submit' value='Set'/>"));
+  out.print_P(PSTR("</form>"));
+
+  if (isCustomColorMap(nightColorMapId)) {
+    writeCustomColorMapSettingsForm(out, nightColorMapId, nightColorMap);
+  }
+
+  char nightBrightnessStr[4];
+  sprintf(nightBrightnessStr, "%i", nightBrightness);
+  out.print_P(PSTR("<h3>Brightness</h3>"));
+  out.print_P(PSTR("<form action='/setnightbrightness' method='POST'>"));
+  out.print_P(PSTR("<input type='range' name='brightness' min='0' max='255' step='1' value='"));
+  out.print(nightBrightnessStr);
+  out.print_P(PSTR("'/>"));
+  out.print_P(PSTR("<input type='submit' value='Set'/>"));
+  out.print_P(PSTR("</form>"));
+  out.print_P(PSTR("</div>"));
+
+  out.print_P(PSTR("</body>"));
+  out.print_P(PSTR("</html>"));
+}
+
+void handleRoot() {
+  ChunkedResponse out;
+  out.begin(200, "text/html");
+  writeRootPage(out);
+  out.end();
+}
+
+void handle_setdaycolormap() {
+  byte choice = strtol(server.arg("colormap").c_str(), NULL, 10);
+  if (choice >= NUM_COLOR_MAPS) choice = 0;
+  dayColorMapId = choice;
+  dayColorMap = getColorMap(choice);
+
+  saveConfiguration();
+  requestUpdate();
+  server.sendHeader("Location", "/", true);
+  server.send(303, "text/plain", "");
+}
+
+void handle_setnightcolormap() {
+  byte choice = strtol(server.arg("colormap").c_str(), NULL, 10);
+  if (choice >= NUM_COLOR_MAPS) choice = 0;
+  nightColorMapId = choice;
+  nightColorMap = getColorMap(choice);
+
+  saveConfiguration();
+  requestUpdate();
+  server.sendHeader("Location", "/", true);
+  server.send(303, "text/plain", "");
+}
+
+void handle_setcustomcolors1() {
+  char color1_str[8];
+  strcpy(color1_str, server.arg("digit1").c_str());
+  cMapValuesCustom1[0] = strtol(color1_str + 1, NULL, 16);
+  char color2_str[8];
+  strcpy(color2_str, server.arg("digit2").c_str());
+  cMapValuesCustom1[1] = strtol(color2_str + 1, NULL, 16);
+  char color3_str[8];
+  strcpy(color3_str, server.arg("digit3").c_str());
+  cMapValuesCustom1[2] = strtol(color3_str + 1, NULL, 16);
+  char color4_str[8];
+  strcpy(color4_str, server.arg("digit4").c_str());
+  cMapValuesCustom1[3] = strtol(color4_str + 1, NULL, 16);
+
+  saveConfiguration();
+  requestUpdate();
+  server.sendHeader("Location", "/", true);
+  server.send(303, "text/plain", "");
+}
+
+void handle_setcustomcolors2() {
+  char color1_str[8];
+  strcpy(color1_str, server.arg("digit1").c_str());
+  cMapValuesCustom2[0] = strtol(color1_str + 1, NULL, 16);
+  char color2_str[8];
+  strcpy(color2_str, server.arg("digit2").c_str());
+  cMapValuesCustom2[1] = strtol(color2_str + 1, NULL, 16);
+  char color3_str[8];
+  strcpy(color3_str, server.arg("digit3").c_str());
+  cMapValuesCustom2[2] = strtol(color3_str + 1, NULL, 16);
+  char color4_str[8];
+  strcpy(color4_str, server.arg("digit4").c_str());
+  cMapValuesCustom2[3] = strtol(color4_str + 1, NULL, 16);
+
+  saveConfiguration();
+  requestUpdate();
+  server.sendHeader("Location", "/", true);
+  server.send(303, "text/plain", "");
+}
+
+void handle_setdaybrightness() {
+  dayBrightness = strtol(server.arg("brightness").c_str(), NULL, 10);
+
+  saveConfiguration();
+  requestUpdate();
+  server.sendHeader("Location", "/", true);
+  server.send(303, "text/plain", "");
+}
+
+void handle_setnightbrightness() {
+  nightBrightness = strtol(server.arg("brightness").c_str(), NULL, 10);
+
+  saveConfiguration();
+  requestUpdate();
+  server.sendHeader("Location", "/", true);
+  server.send(303, "text/plain", "");
+}
+
+void handle_setmodetimes() {
+  char startTimeHoursStr[3] = {0}, startTimeMinutesStr[3] = {0};
+  strncpy(startTimeHoursStr, server.arg("start").c_str(), 2);
+  strncpy(startTimeMinutesStr, server.arg("start").c_str() + 3, 2);
+  int startTimeHours = strtol(startTimeHoursStr, NULL, 10);
+  int startTimeMinutes = strtol(startTimeMinutesStr, NULL, 10);
+  nightModeStartTime = startTimeHours * 100 + startTimeMinutes;
+
+  char endTimeHoursStr[3] = {0}, endTimeMinutesStr[3] = {0};
+  strncpy(endTimeHoursStr, server.arg("end").c_str(), 2);
+  strncpy(endTimeMinutesStr, server.arg("end").c_str() + 3, 2);
+  int endTimeHours = strtol(endTimeHoursStr, NULL, 10);
+  int endTimeMinutes = strtol(endTimeMinutesStr, NULL, 10);
+  nightModeEndTime = endTimeHours * 100 + endTimeMinutes;
+
+  saveConfiguration();
+  requestUpdate();
+  server.sendHeader("Location", "/", true);
+  server.send(303, "text/plain", "");
+}
+
+void handle_setmodeforce() {
+  if (server.arg("force-enabled") == "true") {
+    forceMode |= 1;
+  } else {
+    forceMode &= ~1;
+  }
+
+  if (server.arg("force-which") == "day") {
+    forceMode |= 2;
+  } else if (server.arg("force-which") == "night") {
+    forceMode &= ~2;
+  }
+
+  if (server.arg("force-permanent") == "true") {
+    forceMode |= 4;
+  } else {
+    forceMode &= ~4;
+  }
+
+  saveConfiguration();
+  requestUpdate();
+  server.sendHeader("Location", "/", true);
+  server.send(303, "text/plain", "");
+}
+
+void handle_setctrlsrc() {
+  if (server.arg("ctrl-src") == "standalone") {
+    ctrlSrc = CS_STANDALONE;
+  } else if (server.arg("ctrl-src") == "mqtt") {
+    ctrlSrc = CS_MQTT;
+  } else {
+    ctrlSrc = CS_STANDALONE;
+  }
+
+  saveConfiguration();
+  requestUpdate();
+  server.sendHeader("Location", "/", true);
+  server.send(303, "text/plain", "");
+}
+
+void handle_setbrightnesscurve() {
+  if (server.arg("brightness-curve") == "gamma") {
+    brightnessCurve = BC_GAMMA;
+  } else {
+    brightnessCurve = BC_LINEAR;
+  }
+
+  saveConfiguration();
+  requestUpdate();
+  server.sendHeader("Location", "/", true);
+  server.send(303, "text/plain", "");
+}
+
+void handle_setautobrightness() {
+  autoBrightness = server.arg("auto-brightness") == "true";
+
+  saveConfiguration();
+  requestUpdate();
+  server.sendHeader("Location", "/", true);
+  server.send(303, "text/plain", "");
+}
+
+String generateSegmentColors() {
+  // What the LEDs currently show, including brightness
+  String page;
+  char colorStr[7];
+  for (byte digit = 0; digit < NUM_DIGITS; digit++) {
+    for (byte segment = 0; segment < SEGMENTS_PER_DIGIT; segment++) {
+      sprintf(colorStr, "%06lx", getCommittedSegmentColor(digit, segment));
+      page += colorStr;
+      page += "\n";
+    }
+  }
+  return page;
+}
+
+void handle_getsegmentcolors() {
+  server.send(200, "text/plain", generateSegmentColors());
+}
+
+void handle_frame() {
+  // Snapshot of the NeoPixel buffer, i.e. what the LEDs show right now (also in the middle of a transition)
+  server.sendHeader("Cache-Control", "no-store");
+  if (server.arg("agg") == "segment") {
+    // One RGB triplet per segment of the committed frame, in logical order (digit * SEGMENTS_PER_DIGIT + segment)
+    char frame[NUM_SEGMENTS * 3];
+    for (byte i = 0; i < NUM_SEGMENTS; i++) {
+      unsigned long color = getCommittedSegmentColor(i / SEGMENTS_PER_DIGIT, i % SEGMENTS_PER_DIGIT);
+      frame[i * 3] = color >> 16;
+      frame[i * 3 + 1] = color >> 8;
+      frame[i * 3 + 2] = color;
+    }
+    server.send(200, "application/octet-stream", frame, sizeof(frame));
+  } else {
+    // All pixels in wiring order, in the byte order of the strip
+    server.sendHeader("X-Pixel-Order", PIXEL_ORDER_NAME);
+    server.send(200, "application/octet-stream", (const char*)pixels.getPixels(), NUM_LEDS * 3);
+  }
+}
+
+int writeState(char* buf, size_t size) {
+  // Everything the static control page (data/index.html) needs, in one compact JSON document
+  const unsigned long* custom1 = cMapValuesCustom1;
+  const unsigned long* custom2 = cMapValuesCustom2;
+  // curColorMapId is only kept up to date in standalone mode, MQTT sets a single colour instead
+  char colorMapId[8] = "null";
+  if (ctrlSrc != CS_MQTT) snprintf(colorMapId, sizeof(colorMapId), "%d", curColorMapId);
+  int length = snprintf(buf, size,
+                  "{\"time\":%d,\"night_mode\":%s,\"night_start\":%d,\"night_end\":%d,"
+                  "\"force_mode\":%d,\"ctrl_src\":\"%s\","
+                  "\"brightness\":%d,\"brightness_curve\":\"%s\",\"auto_brightness\":%s,\"colormap\":%s,"
+                  "\"day\":{\"colormap\":%d,\"brightness\":%d},"
+                  "\"night\":{\"colormap\":%d,\"brightness\":%d},"
+                  "\"mqtt\":{\"on\":%s,\"brightness\":%d,\"color\":\"#%06lx\"},\"seed\":%lu,"
+                  "\"custom\":{\"ids\":[5,6],\"colors\":["
+                  "[\"#%06lx\",\"#%06lx\",\"#%06lx\",\"#%06lx\"],"
+                  "[\"#%06lx\",\"#%06lx\",\"#%06lx\",\"#%06lx\"]]},\"colormaps\":[",
+                  curTime, nightMode ? "true" : "false", nightModeStartTime, nightModeEndTime,
+                  forceMode, ctrlSrc == CS_MQTT ? "mqtt" : "standalone",
+                  curBrightness, brightnessCurve == BC_GAMMA ? "gamma" : "linear", autoBrightness ? "true" : "false", colorMapId,
+                  dayColorMapId, dayBrightness,
+                  nightColorMapId, nightBrightness,
+                  mqttOnState ? "true" : "false", mqttBrightness, cMapValuesMQTT[0], (unsigned long)colorMapSeed,
+                  custom1[0], custom1[1], custom1[2], custom1[3],
+                  custom2[0], custom2[1], custom2[2], custom2[3]);
+
+  // Names of all colour maps by ID, from PROGMEM, so copied by hand instead of through %s
+  for (byte i = 0; i < NUM_COLOR_MAPS; i++) {
+    size_t nameLength = strlen_P(COLOR_MAP_NAMES[i]);
+    // ,"name" and the closing ]} with terminator
+    if (length < 0 || length + nameLength + 6 > size) return size;
+    if (i > 0) buf[length++] = ',';
+    buf[length++] = '"';
+    memcpy_P(buf + length, COLOR_MAP_NAMES[i], nameLength);
+    length += nameLength;
+    buf[length++] = '"';
+  }
+  memcpy(buf + length, "]}", 3);
+  return length + 2;
+}
+
+void handle_apistate() {
+  char state[WEB_STATE_BUFFER_SIZE];
+  int length = writeState(state, sizeof(state));
+  if (length < 0 || length >= (int)sizeof(state)) {
+    server.send(500, "text/plain", "State too large");
+    return;
+  }
+  server.sendHeader("Cache-Control", "no-store");
+  server.send(200, "application/json", state, length);
+}
+
+#ifdef ENABLE_BENCHMARK
+void handle_benchmark() {
+  server.send(200, "application/json", runBenchmarks());
+}
+#endif
+
+uint32_t heapMaxFreeBlock() {
+#ifdef ARDUINO_ARCH_ESP8266
+  // Core 2.4.1 has no ESP.getMaxFreeBlockSize() yet, ask umm_malloc directly
+  umm_info(NULL, 0);
+  return (uint32_t)ummHeapInfo.maxFreeContiguousBlocks * UMM_BLOCK_BYTES;
+#else
+  return ESP.getMaxFreeBlockSize();
+#endif
+}
+
+char* formatUint64(char* buf, size_t size, uint64_t value) {
+  char* p = buf + size - 1;
+  *p = 0x00;
+  do {
+    *--p = '0' + value % 10;
+    value /= 10;
+  } while (value > 0 && p > buf);
+  return p;
+}
+
+void writeLoopHistogram(ChunkedResponse& out) {
+  char bound[12];
+  out.printMetricType(PSTR("scheduler_loop_duration_us"), METRIC_HISTOGRAM);
+  for (byte i = 0; i < SCHEDULER_LOOP_BUCKETS; i++) {
+    snprintf(bound, sizeof(bound), "%lu", schedulerLoopBucketBoundUs(i));
+    out.printSample(PSTR("scheduler_loop_duration_us_bucket"), PSTR("le"), bound, schedulerLoopBucketCount(i));
+  }
+  out.printSample(PSTR("scheduler_loop_duration_us_bucket"), PSTR("le"), "+Inf", schedulerLoopBucketCount(SCHEDULER_LOOP_BUCKETS));
+  out.printSample(PSTR("scheduler_loop_duration_us_count"), NULL, NULL, schedulerLoopBucketCount(SCHEDULER_LOOP_BUCKETS));
+  char number[24];
+  out.print_P(PSTR("scheduler_loop_duration_us_sum "));
+  out.print(formatUint64(number, sizeof(number), schedulerLoopTotalUs()));
+  out.print_P(PSTR("\n"));
+}
+
+void writeSchedulerJobStats(ChunkedResponse& out) {
+  // Samples of a metric have to be grouped, so one pass over the jobs per metric
+  out.printMetricType(PSTR("scheduler_job_runs_total"), METRIC_COUNTER);
+  for (byte id = 0; id < schedulerJobCount(); id++) {
+    const SchedulerJobInfo* job = schedulerJobInfo(id);
+    out.printSample(PSTR("scheduler_job_runs_total"), PSTR("job"), job->name, job->runs);
+  }
+  out.printMetricType(PSTR("scheduler_job_lateness_max_ms"), METRIC_GAUGE);
+  for (byte id = 0; id < schedulerJobCount(); id++) {
+    const SchedulerJobInfo* job = schedulerJobInfo(id);
+    out.printSample(PSTR("scheduler_job_lateness_max_ms"), PSTR("job"), job->name, job->latenessMaxMs);
+  }
+  out.printMetricType(PSTR("scheduler_job_lateness_avg_ms"), METRIC_GAUGE);
+  for (byte id = 0; id < schedulerJobCount(); id++) {
+    const SchedulerJobInfo* job = schedulerJobInfo(id);
+    out.printSample(PSTR("scheduler_job_lateness_avg_ms"), PSTR("job"), job->name,
+                    job->runs ? job->latenessTotalMs / job->runs : 0);
+  }
+}
+
+void handle_metrics() {
+  // Prometheus text format, streamed so it costs no heap however many modules add lines
+  ChunkedResponse out;
+  out.begin(200, "text/plain; version=0.0.4");
+  char number[24];
+
+  out.printMetricType(PSTR("uptime_ms"), METRIC_GAUGE);
+  out.print_P(PSTR("uptime_ms "));
+  out.print(formatUint64(number, sizeof(number), timekeepingUptimeMs()));
+  out.print_P(PSTR("\n"));
+
+  uint32_t freeHeap = ESP.getFreeHeap();
+  uint32_t maxFreeBlock = heapMaxFreeBlock();
+  out.printMetric(PSTR("heap_free_bytes"), METRIC_GAUGE, freeHeap);
+  out.printMetric(PSTR("heap_max_free_block_bytes"), METRIC_GAUGE, maxFreeBlock);
+  out.printMetric(PSTR("heap_fragmentation_percent"), METRIC_GAUGE,
+                  freeHeap > 0 ? (unsigned long)(100 - (uint64_t)maxFreeBlock * 100 / freeHeap) : 0UL);
+  out.printMetric(PSTR("web_heap_peak_bytes"), METRIC_GAUGE, webHeapPeakLast);
+  out.printMetric(PSTR("web_heap_peak_max_bytes"), METRIC_GAUGE, webHeapPeakMax);
+
+  out.printMetric(PSTR("frames_committed_total"), METRIC_COUNTER, framesCommitted);
+  out.printMetric(PSTR("frames_skipped_total"), METRIC_COUNTER, framesSkipped);
+  out.printMetric(PSTR("display_show_total"), METRIC_COUNTER, showCount);
+  out.printMetric(PSTR("display_show_us_total"), METRIC_COUNTER, showTotalUs);
+  out.printMetric(PSTR("display_show_max_us"), METRIC_GAUGE, showMaxUs);
+  out.printMetric(PSTR("display_frame_listeners_dropped_total"), METRIC_COUNTER, frameListenersDropped);
+
+  // Left out while no job is enabled, there is no deadline then
+  unsigned long nextDeadlineMs = schedulerMsToNextDeadline();
+  if (nextDeadlineMs != SCHEDULER_NO_DEADLINE) {
+    out.printMetric(PSTR("scheduler_next_deadline_ms"), METRIC_GAUGE, nextDeadlineMs);
+  }
+  out.printMetric(PSTR("scheduler_idle_ms_total"), METRIC_COUNTER, schedulerIdleTotalMs());
+  out.printMetric(PSTR("scheduler_loop_max_ms"), METRIC_GAUGE, schedulerLoopMaxMs());
+  out.printMetric(PSTR("scheduler_jobs_dropped_total"), METRIC_COUNTER, schedulerJobsDropped());
+  writeLoopHistogram(out);
+  writeSchedulerJobStats(out);
+
+  out.printMetric(PSTR("web_stats_writers_dropped_total"), METRIC_COUNTER, statsWritersDropped);
+  for (byte i = 0; i < numStatsWriters; i++) {
+    statsWriters[i](out);
+  }
+  out.end();
+}
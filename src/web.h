@@ -0,0 +1,121 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+*/
+
+#ifndef WEB_H
+#define WEB_H
+
+#include <ESP8266WebServer.h>
+
+#define WEB_MAX_STATS_WRITERS 16
+#define WEB_MAX_ROUTES 32
+#define WEB_CHUNK_BUFFER_SIZE 256
+#define WEB_STATE_BUFFER_SIZE 768
+
+class WebServer : public ESP8266WebServer {
+  public:
+    WebServer(int port) : ESP8266WebServer(port) {}
+    using ESP8266WebServer::send;
+    using ESP8266WebServer::sendContent;
+    // Like send_P() / sendContent_P(), for content in RAM. Binary safe, without a String copy.
+    void send(int code, const char* contentType, const char* content, size_t length);
+    void sendContent(const char* content, size_t length);
+    // For handlers that keep the connection (see handle_events()). Makes the server forget the
+    // current client once the handler returns, instead of waiting in HC_WAIT_CLOSE for up to
+    // 2 s for it to hang up and serving no one else meanwhile.
+    void releaseClient();
+};
+
+extern WebServer server;
+
+// Prometheus metric types, for the "# TYPE" line every metric starts with
+enum MetricType {
+  METRIC_COUNTER,  // Name ends in _total
+  METRIC_GAUGE,
+  METRIC_HISTOGRAM
+};
+
+// Streams a response with chunked transfer encoding through a small fixed buffer,
+// so pages don't have to be assembled in one (heap fragmenting) String first.
+class ChunkedResponse {
+  public:
+    ChunkedResponse();
+    void begin(int code, const char* contentType);
+    // Only count the generated bytes, nothing is sent (used by the benchmarks)
+    void beginDiscard();
+    void print(const char* str);
+    void print_P(PGM_P str);
+    // Prometheus text format, names and labels are PSTR()s.
+    // "# TYPE" line, followed by the samples of that metric (and nothing else)
+    void printMetricType(PGM_P name, MetricType type);
+    // "name{label="labelValue"} value", label may be NULL
+    void printSample(PGM_P name, PGM_P label, const char* labelValue, unsigned long value);
+    // "# TYPE" line and the only sample of a metric without labels
+    void printMetric(PGM_P name, MetricType type, unsigned long value);
+    void printSignedMetric(PGM_P name, MetricType type, long value);
+    void end();
+    size_t bytesWritten() const;
+
+  private:
+    void append(const char* data, size_t length, bool progmem);
+    void flush();
+    void sampleHeap();
+
+    char buffer[WEB_CHUNK_BUFFER_SIZE];
+    size_t length;
+    size_t total;
+    bool discard;
+    uint32_t heapStart;
+    uint32_t heapMin;
+};
+
+// Decimal digits of value, written to the end of buf. Returns where they start.
+// snprintf on the device can't be relied on for 64 bit values.
+char* formatUint64(char* buf, size_t size, uint64_t value);
+
+// Heap used while streaming the last response, and the maximum seen so far
+extern uint32_t webHeapPeakLast;
+extern uint32_t webHeapPeakMax;
+
+// Lets modules outside of the web code append their own lines to /metrics.
+// A full table is a build error in disguise: it asserts, and counts the writer as dropped with NDEBUG.
+typedef void (*StatsWriter)(ChunkedResponse& out);
+bool webAddStatsWriter(StatsWriter writer);
+
+// server.on(), with -D ENABLE_TRACE the handler is wrapped in a trace scope named after the URI
+void webOn(const char* uri, ESP8266WebServer::THandlerFunction handler);
+#ifdef ENABLE_TRACE
+// Route number for a TRACE_WEB_HANDLER scope around a handler not registered with webOn()
+// (like a RequestHandler). Past WEB_MAX_ROUTES the scope is still recorded, just not named.
+uint16_t webTraceRoute(const char* uri);
+// URI of a route registered with webOn() or webTraceRoute(), NULL if there is none with that number
+const char* webRouteUri(byte route);
+#endif
+
+void writeRootPage(ChunkedResponse& out);
+int writeState(char* buf, size_t size);
+String generateSegmentColors();
+
+void handleNotFound();
+void handleRoot();
+void handle_setdaycolormap();
+void handle_setnightcolormap();
+void handle_setcustomcolors1();
+void handle_setcustomcolors2();
+void handle_setdaybrightness();
+void handle_setnightbrightness();
+void handle_setmodetimes();
+void handle_setmodeforce();
+void handle_setctrlsrc();
+void handle_setbrightnesscurve();
+void handle_setautobrightness();
+void handle_getsegmentcolors();
+void handle_frame();
+void handle_apistate();
+#ifdef ENABLE_BENCHMARK
+void handle_benchmark();
+#endif
+void handle_metrics();
+
+#endif
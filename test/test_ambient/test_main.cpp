@@ -0,0 +1,109 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Auto-brightness, replaying the dusk ADC trace through sampling, filtering, curve and render.
+   Run with: pio test -e native (from the project directory, the trace is read relative to it)
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+
+#include "ambient.h"
+#include "display.h"
+#include "simulation.h"
+
+#define TRACE_PATH "native/traces/ldr_dusk.txt"
+// The trace darkens from 0 s, the lamp comes on at 200 s and is steady (apart from noise and
+// spikes) some seconds later
+#define DUSK_END_MS 200000UL
+#define LAMP_SETTLED_MS 210000UL
+// Dusk moves the level by about 630 counts, the lamp by about 320, so one change per
+// AMBIENT_HYSTERESIS of travel is 40 at most
+#define MAX_OUTPUT_CHANGES 40
+
+const AmbientCurvePoint curve[] = AMBIENT_CURVE;
+#define CURVE_SIZE (sizeof(curve) / sizeof(curve[0]))
+
+// Brightness after every sample, index * AMBIENT_SAMPLE_INTERVAL_MS is the time of the sample
+std::vector<byte> brightness;
+unsigned long outputChanges;
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_trace_was_replayed() {
+  TEST_ASSERT_EQUAL(3000, brightness.size());
+}
+
+void test_output_changes_are_bounded() {
+  TEST_ASSERT_TRUE(outputChanges > 0);
+  TEST_ASSERT_TRUE_MESSAGE(outputChanges <= MAX_OUTPUT_CHANGES, "Brightness flickers");
+}
+
+void test_brightness_is_within_curve() {
+  for (size_t i = 0; i < brightness.size(); i++) {
+    TEST_ASSERT_TRUE(brightness[i] >= curve[0].brightness);
+    TEST_ASSERT_TRUE(brightness[i] <= curve[CURVE_SIZE - 1].brightness);
+  }
+}
+
+void test_brightness_falls_monotonically_at_dusk() {
+  size_t duskEnd = DUSK_END_MS / AMBIENT_SAMPLE_INTERVAL_MS;
+  for (size_t i = 1; i < duskEnd; i++) {
+    TEST_ASSERT_TRUE_MESSAGE(brightness[i] <= brightness[i - 1], "Brightness rose at dusk");
+  }
+  TEST_ASSERT_TRUE(brightness[duskEnd - 1] < brightness[0]);
+}
+
+void test_brightness_is_steady_under_lamp() {
+  size_t settled = LAMP_SETTLED_MS / AMBIENT_SAMPLE_INTERVAL_MS;
+  TEST_ASSERT_TRUE(brightness[settled] > brightness[DUSK_END_MS / AMBIENT_SAMPLE_INTERVAL_MS - 1]);
+  for (size_t i = settled + 1; i < brightness.size(); i++) {
+    TEST_ASSERT_EQUAL_MESSAGE(brightness[settled], brightness[i], "Noise or a spike moved the brightness");
+  }
+}
+
+void test_filter_restarts_when_reenabled() {
+  // Runs last, after the replay
+  autoBrightness = false;
+  for (byte i = 0; i < 20; i++) simulateAdcSample(100);
+  TEST_ASSERT_NOT_EQUAL(100, ambientLevel());
+
+  // The first sample after turning it on sets the level and brightness, no EMA or hysteresis
+  autoBrightness = true;
+  simulateAdcSample(100);
+  TEST_ASSERT_EQUAL(100, ambientLevel());
+  TEST_ASSERT_EQUAL(ambientCurve(100), curBrightness);
+}
+
+int main() {
+  simulationBegin();
+  simulationBeginAmbient();
+  FILE* trace = fopen(TRACE_PATH, "r");
+  if (trace != NULL) {
+    int raw;
+    while (readAdcTrace(trace, &raw)) {
+      simulateAdcSample(raw);
+      brightness.push_back(curBrightness);
+    }
+    fclose(trace);
+  }
+  outputChanges = ambientOutputChanges();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_trace_was_replayed);
+  // The others index into the replay
+  if (brightness.size() == 3000) {
+    RUN_TEST(test_output_changes_are_bounded);
+    RUN_TEST(test_brightness_is_within_curve);
+    RUN_TEST(test_brightness_falls_monotonically_at_dusk);
+    RUN_TEST(test_brightness_is_steady_under_lamp);
+    RUN_TEST(test_filter_restarts_when_reenabled);
+  }
+  return UNITY_END();
+}
@@ -0,0 +1,63 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Brightness lookup table. Run with: pio test -e native
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "display.h"
+
+void setUp() {
+  brightnessCurve = BC_LINEAR;
+}
+
+void tearDown() {
+}
+
+// How applyBrightness() scaled a channel before the lookup table
+byte mapChannel(unsigned long value, byte brightness) {
+  return map(value * brightness, 0, 65025, 0, 255);
+}
+
+void test_linear_lut_matches_map() {
+  for (int brightness = 0; brightness < 256; brightness++) {
+    curBrightness = brightness;
+    updateBrightnessLUT();
+    for (int value = 0; value < 256; value++) {
+      // A different value in every channel, so swapped channels would show up too
+      unsigned long red = value;
+      unsigned long green = 255 - value;
+      unsigned long blue = value ^ 0xA5;
+      unsigned long expected = (unsigned long)mapChannel(red, brightness) << 16 |
+                               (unsigned long)mapChannel(green, brightness) << 8 |
+                               mapChannel(blue, brightness);
+      unsigned long scaled = applyBrightness(red << 16 | green << 8 | blue);
+      if (scaled != expected) {
+        char message[64];
+        snprintf(message, sizeof(message), "value %d, brightness %d", value, brightness);
+        TEST_ASSERT_EQUAL_HEX32_MESSAGE(expected, scaled, message);
+      }
+    }
+  }
+}
+
+void test_lut_follows_curve_change() {
+  curBrightness = 64;
+  updateBrightnessLUT();
+  unsigned long linear = applyBrightness(0x808080);
+  brightnessCurve = BC_GAMMA;
+  updateBrightnessLUT();
+  TEST_ASSERT_TRUE(applyBrightness(0x808080) != linear);
+  // Gamma keeps dim channels lit
+  TEST_ASSERT_EQUAL_HEX32(0x010101, applyBrightness(0x010101));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_linear_lut_matches_map);
+  RUN_TEST(test_lut_follows_curve_change);
+  return UNITY_END();
+}
@@ -0,0 +1,115 @@
+/*
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Render path and frame diffing against the stand-in strip. Run with: pio test -e native
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "display.h"
+#include "simulation.h"
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+// Committed colour of every segment, read back from the last recorded show()
+void assertLastFrameMatchesCommittedColors() {
+  TEST_ASSERT_TRUE(pixels.frames.size() > 0);
+  const std::vector<uint8_t>& frame = pixels.frames.back();
+  for (byte i = 0; i < NUM_SEGMENTS; i++) {
+    unsigned long color = getCommittedSegmentColor(i / SEGMENTS_PER_DIGIT, i % SEGMENTS_PER_DIGIT);
+    for (byte led = 0; led < LEDS_PER_SEGMENT; led++) {
+      const uint8_t* pixel = &frame[(SEG_LAYOUT::startPixel[i] + led) * 3];
+      unsigned long shown = (unsigned long)pixel[PIXEL_R_OFFSET] << 16 | (unsigned long)pixel[PIXEL_G_OFFSET] << 8 | pixel[PIXEL_B_OFFSET];
+      TEST_ASSERT_EQUAL_HEX32_MESSAGE(color, shown, "Pixel doesn't show the committed segment colour");
+    }
+  }
+}
+
+void test_day_commits_one_frame_per_minute() {
+  unsigned long committedBefore = framesCommitted;
+  unsigned long skippedBefore = framesSkipped;
+  size_t shownBefore = pixels.frames.size();
+  simulateDay(false);
+
+  // 12 updates per minute, only the first one changes anything
+  TEST_ASSERT_EQUAL(1440, framesCommitted - committedBefore);
+  TEST_ASSERT_EQUAL(1440 * 11, framesSkipped - skippedBefore);
+  TEST_ASSERT_EQUAL(1440, pixels.frames.size() - shownBefore);
+  assertLastFrameMatchesCommittedColors();
+}
+
+void test_unchanged_frame_is_skipped() {
+  curTime = 1234;
+  updateAll();
+  unsigned long committedBefore = framesCommitted;
+  size_t shownBefore = pixels.frames.size();
+  updateAll();
+  TEST_ASSERT_EQUAL(committedBefore, framesCommitted);
+  TEST_ASSERT_EQUAL(shownBefore, pixels.frames.size());
+}
+
+void test_brightness_change_commits_frame() {
+  curTime = 1234;
+  dayBrightness = 255;
+  updateAll();
+  unsigned long committedBefore = framesCommitted;
+  dayBrightness = 100;
+  updateAll();
+  TEST_ASSERT_EQUAL(committedBefore + 1, framesCommitted);
+  assertLastFrameMatchesCommittedColors();
+
+  // Lit segments show the map colour scaled linearly, unlit ones stay off
+  for (byte digit = 0; digit < NUM_DIGITS; digit++) {
+    for (byte segment = 0; segment < SEGMENTS_PER_DIGIT; segment++) {
+      unsigned long expected = 0x000000;
+      if (SEG_BUF[digit] & (1 << segment)) {
+        unsigned long color = getColor(digit, segment, *dayColorMap);
+        for (byte shift = 0; shift <= 16; shift += 8) {
+          expected |= (((color >> shift) & 0xFF) * 100 / 255) << shift;
+        }
+      }
+      TEST_ASSERT_EQUAL_HEX32(expected, getCommittedSegmentColor(digit, segment));
+    }
+  }
+  dayBrightness = 255;
+}
+
+void test_custom_color_edit_commits_frame() {
+  // The map pointer stays the same, only its hash tells the colours apart
+  curTime = 1234;
+  dayColorMap = getColorMap(dayColorMapId = 5);
+  cMapValuesCustom1[0] = 0xFF0000;
+  updateAll();
+  unsigned long committedBefore = framesCommitted;
+  cMapValuesCustom1[0] = 0x00FF00;
+  updateAll();
+  TEST_ASSERT_EQUAL(committedBefore + 1, framesCommitted);
+  assertLastFrameMatchesCommittedColors();
+  dayColorMap = getColorMap(dayColorMapId = 1);
+}
+
+void test_invalidated_frame_is_repainted() {
+  curTime = 1234;
+  updateAll();
+  unsigned long committedBefore = framesCommitted;
+  invalidateFrame();
+  updateAll();
+  TEST_ASSERT_EQUAL(committedBefore + 1, framesCommitted);
+}
+
+int main() {
+  simulationBegin();
+  UNITY_BEGIN();
+  RUN_TEST(test_day_commits_one_frame_per_minute);
+  RUN_TEST(test_unchanged_frame_is_skipped);
+  RUN_TEST(test_brightness_change_commits_frame);
+  RUN_TEST(test_custom_color_edit_commits_frame);
+  RUN_TEST(test_invalidated_frame_is_repainted);
+  return UNITY_END();
+}
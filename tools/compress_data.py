@@ -0,0 +1,56 @@
+"""
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   PlatformIO pre script: gzip the web assets before the filesystem image is built.
+
+   data/ is copied to a staging directory in the build folder, where every compressible
+   file is replaced by its .gz variant (if that is actually smaller). The SPIFFS image is
+   built from the staging directory, so the originals in data/ stay editable and the
+   image doesn't hold both versions. static_assets.cpp serves the .gz files with
+   Content-Encoding: gzip.
+"""
+
+import gzip
+import os
+import shutil
+
+Import("env")
+from SCons.Script import COMMAND_LINE_TARGETS
+
+COMPRESS_EXTENSIONS = (".html", ".css", ".js", ".svg", ".ico", ".json")
+
+
+def compress(src, dst):
+    with open(src, "rb") as f:
+        data = f.read()
+    # Fixed mtime and no file name in the header, so the output (and the ETag) only depends on the content
+    with open(dst, "wb") as f:
+        with gzip.GzipFile(filename="", mode="wb", compresslevel=9, fileobj=f, mtime=0) as gz:
+            gz.write(data)
+    return len(data), os.path.getsize(dst)
+
+
+def stage_data_dir(data_dir, staging_dir):
+    if os.path.isdir(staging_dir):
+        shutil.rmtree(staging_dir)
+    os.makedirs(staging_dir)
+    for name in sorted(os.listdir(data_dir)):
+        src = os.path.join(data_dir, name)
+        if not os.path.isfile(src) or name.endswith(".gz"):
+            continue
+        dst = os.path.join(staging_dir, name)
+        if name.endswith(COMPRESS_EXTENSIONS):
+            size, gz_size = compress(src, dst + ".gz")
+            if gz_size < size:
+                print("compress_data: %s %d -> %d bytes" % (name, size, gz_size))
+                continue
+            os.remove(dst + ".gz")
+        shutil.copy2(src, dst)
+
+
+if any(target in COMMAND_LINE_TARGETS for target in ("buildfs", "uploadfs", "uploadfsota")):
+    data_dir = env.subst("$PROJECT_DATA_DIR")
+    staging_dir = os.path.join(env.subst("$BUILD_DIR"), "data_gz")
+    stage_data_dir(data_dir, staging_dir)
+    env.Replace(PROJECT_DATA_DIR=staging_dir)
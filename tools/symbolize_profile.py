@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""
+   WS2812 RGB Digital Clock for ESP8266
+   (C) 2016-2020 Julian Metzler
+
+   Symbolizes a /profile dump (firmware built with -D ENABLE_PROFILER) against the firmware ELF
+   and prints where the samples landed, per function or per source line.
+
+   Usage: symbolize_profile.py [--lines] [--top N] [--addr2line PATH] <elf> <profile>
+     <elf>      .pioenvs/esp12e/firmware.elf, or .pioenvs/native/program for a --profile run
+     <profile>  File, http:// URL (e.g. http://rgbclock/profile) or - for stdin
+
+   addr2line is taken from the Xtensa toolchain PlatformIO installed for ESP8266 ELF files.
+   Addresses in the ESP8266 boot ROM aren't in the ELF and are reported as [rom].
+"""
+
+import argparse
+import collections
+import glob
+import os
+import shutil
+import subprocess
+import sys
+import urllib.request
+
+ELF_MACHINE_XTENSA = 94
+ROM_START = 0x40000000
+ROM_END = 0x40010000
+
+
+def read_profile(source):
+    if source == "-":
+        text = sys.stdin.read()
+    elif source.startswith("http://") or source.startswith("https://"):
+        with urllib.request.urlopen(source) as response:
+            text = response.read().decode("ascii")
+    else:
+        with open(source) as f:
+            text = f.read()
+
+    header = {}
+    samples = []
+    for line in text.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[0] == "#":
+            header[fields[1]] = int(fields[2], 0)
+        elif len(fields) == 2:
+            samples.append((int(fields[0], 16), int(fields[1])))
+    return header, samples
+
+
+def elf_machine(path):
+    with open(path, "rb") as f:
+        ident = f.read(20)
+    if ident[:4] != b"\x7fELF":
+        sys.exit("%s is not an ELF file" % path)
+    byteorder = "little" if ident[5] == 1 else "big"
+    return int.from_bytes(ident[18:20], byteorder)
+
+
+def find_addr2line(elf):
+    if elf_machine(elf) != ELF_MACHINE_XTENSA:
+        return "addr2line"
+    name = "xtensa-lx106-elf-addr2line"
+    if shutil.which(name):
+        return name
+    pattern = os.path.join(os.path.expanduser("~"), ".platformio", "packages", "toolchain-xtensa*", "bin", name)
+    found = sorted(glob.glob(pattern))
+    if not found:
+        sys.exit("%s not found, pass it with --addr2line" % name)
+    return found[-1]
+
+
+def symbolize(addr2line, elf, addresses):
+    # -f prints two lines per address: the function, then file:line
+    query = "".join("0x%x\n" % address for address in addresses)
+    output = subprocess.run([addr2line, "-f", "-C", "-e", elf], input=query, stdout=subprocess.PIPE,
+                            universal_newlines=True, check=True).stdout.splitlines()
+    symbols = {}
+    for i, address in enumerate(addresses):
+        function, location = output[2 * i], output[2 * i + 1]
+        if location.startswith("??"):
+            location = "??"
+        else:
+            # Drop the directory and anything after the line number, like " (discriminator 2)"
+            location = os.path.basename(location.split(" ")[0])
+        symbols[address] = (function, location)
+    return symbols
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Symbolize a /profile dump")
+    parser.add_argument("elf")
+    parser.add_argument("profile")
+    parser.add_argument("--lines", action="store_true", help="Group by source line instead of function")
+    parser.add_argument("--top", type=int, default=40, help="Rows to print (default: 40, 0 for all)")
+    parser.add_argument("--addr2line", help="addr2line binary matching the ELF")
+    args = parser.parse_args()
+
+    header, samples = read_profile(args.profile)
+    if not samples:
+        sys.exit("No samples in the profile")
+    base = header.get("base", 0)
+    addr2line = args.addr2line or find_addr2line(args.elf)
+
+    in_elf = sorted(set(pc - base for pc, count in samples if not ROM_START <= pc < ROM_END))
+    symbols = symbolize(addr2line, args.elf, in_elf)
+
+    totals = collections.Counter()
+    for pc, count in samples:
+        if ROM_START <= pc < ROM_END:
+            key = "[rom]"
+        else:
+            function, location = symbols[pc - base]
+            if function == "??":
+                function = "[unknown 0x%x]" % pc
+            key = "%s  %s" % (function, location) if args.lines else function
+        totals[key] += count
+
+    total = sum(count for pc, count in samples)
+    print("%d samples at %d Hz, %d dropped (histogram full or unknown address)" %
+          (total, header.get("hz", 0), header.get("dropped", 0)))
+    print("%8s %7s  %s" % ("samples", "%", "line" if args.lines else "function"))
+    for key, count in totals.most_common(args.top or None):
+        print("%8d %6.2f%%  %s" % (count, 100.0 * count / total, key))
+
+
+if __name__ == "__main__":
+    main()